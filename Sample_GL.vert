@@ -5,6 +5,8 @@ layout (location = 0) in vec3 vertexPosition;
 layout (location = 1) in vec3 vertexColor;
 
 uniform mat4 MVP;
+// Same clip position as TextureRender.vert, for the depth pre-pass
+invariant gl_Position;
 
 // output data : used by fragment shader
 out vec3 fragColor;
@@ -1,37 +1,52 @@
 #version 330 core
 
+// Lighting is chosen per level when the program is built:
+//   LIGHT_SPOT  level 2, a flashlight in the player's view direction,
+//               with a soft edge if LIGHT_SMOOTH is defined too
+//   LIGHT_DIM   level 3, everything darker
+//   neither     level 1, plain texture colour
+
 // Interpolated values from the vertex shaders
 in vec2 fragTexCoord;
 in vec3 objectPositionout;
-in vec3 playerPositionout;
-in float playerAngleout;
-in float levelout;
-in float isPortalout;
 // output data
 out vec4 colorout;
 
 // Texture sample for the whole mesh
 uniform sampler2D texSampler;
+#ifdef LIGHT_SPOT
+uniform vec3 playerPosition;
+// Unit vector the player looks along and the cosine of the beam's half
+// angle, both worked out once per frame instead of per fragment
+uniform vec3 spotDirection;
+uniform float spotCutoff;
+#ifdef LIGHT_SMOOTH
+// Cosine of the angle up to which the beam is at full brightness
+uniform float spotInner;
+#endif
+#endif
 
 void main()
 {
     // Output color = color from texture sample specified in the vertex shader,
     // interpolated between all 3 surrounding vertices of the triangle
-    vec3 playerDirection = vec3(10*sin((3.14/180)*playerAngleout),0,-10*cos((3.14/180)*playerAngleout));
-    vec3 vertexDirection = objectPositionout-playerPositionout;
-    float angle = acos(dot(playerDirection,vertexDirection)/(length(playerDirection)*length(vertexDirection))) *(180/3.14);
     vec4 xyz = texture( texSampler, fragTexCoord ).rgba;
     vec3 color=xyz.xyz;
     float apl=xyz.a;
-    float dist = length(objectPositionout - playerPositionout);
-    if(levelout == 2)
-    if(angle<=25)
-	    color = color * (1.0/dist) * 10.0;
-    else
-	    color = color * (1.0/dist) * 3.0;
-    if(levelout == 3)
-	    color = color *0.7;
-    else
-	    color=color*1;
+#ifdef LIGHT_SPOT
+    vec3 vertexDirection = objectPositionout-playerPosition;
+    float inverseDist = inversesqrt(dot(vertexDirection, vertexDirection));
+    // Cosine of the angle off the beam, compared against cosines so no acos is needed
+    float cosAngle = dot(spotDirection, vertexDirection) * inverseDist;
+#ifdef LIGHT_SMOOTH
+    float beam = mix(3.0, 10.0, smoothstep(spotCutoff, spotInner, cosAngle));
+#else
+    float beam = cosAngle >= spotCutoff ? 10.0 : 3.0;
+#endif
+    color = color * (beam * inverseDist);
+#endif
+#ifdef LIGHT_DIM
+    color = color *0.7;
+#endif
     colorout = vec4(color,apl);
 }
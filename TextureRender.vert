@@ -5,19 +5,13 @@ layout (location = 0) in vec3 vertexPosition;
 layout (location = 2) in vec2 vertexTexCoord;
 
 uniform mat4 MVP;
+// Same clip position as Sample_GL.vert, for the depth pre-pass
+invariant gl_Position;
 uniform vec3 objectPosition;
-uniform vec3 playerPosition;
-uniform float playerAngle;
-uniform float level;
-uniform float isPortal;
 
 // output data : used by fragment shader
 out vec2 fragTexCoord;
 out vec3 objectPositionout;
-out vec3 playerPositionout;
-out float playerAngleout;
-out float levelout;
-out float isPortalout;
 void main ()
 {
     vec4 v = vec4(vertexPosition, 1); // Transform an homogeneous 4D vector
@@ -30,8 +24,4 @@ void main ()
     gl_Position = MVP * v;
 
     objectPositionout = objectPosition + vertexPosition;
-    playerPositionout = playerPosition;
-    playerAngleout = playerAngle;
-    levelout = level;
-    isPortalout = isPortal;
 }
@@ -0,0 +1,353 @@
+#include <cmath>
+
+#include "agent.h"
+#include "jobsystem.h"
+
+using namespace std;
+
+#define AGENT_GRAIN 64
+#define RESPAWN_DEPTH -200
+// Gap left between an agent and the block it walks into
+#define SWEEP_SKIN 0.01f
+
+Agent::Agent() : posx(0), posy(10), posz(0), angle(0), speed(1), speedy(0), jump(0), falling(0),
+	movefront(0), moveback(0), moveleft(0), moveright(0), turn_left(0), turn_right(0),
+	seed(1), think_ticks(0), spawnx(0), spawnz(0)
+{
+}
+
+void placeAgent(const Course &course, Agent &agent, int i, int j)
+{
+	agent.posx = course.cellX(j);
+	agent.posy = 10;
+	agent.posz = course.cellZ(i);
+	agent.angle = 0;
+	agent.speedy = 0;
+	agent.jump = agent.falling = 0;
+	agent.spawnx = agent.posx;
+	agent.spawnz = agent.posz;
+}
+
+void resetAgent(const Course &course, Agent &agent)
+{
+	placeAgent(course, agent, course.nvert - 1, 0);
+}
+
+int agentOnGround(const Course &course, Agent &agent){
+	float edge = course.edge, nhor = course.nhor, nvert = course.nvert;
+	if(agent.posy == 10)
+		return 1;
+	for(int p = 0;p<course.blocks.size();p++){
+		int i = course.blocks[p].first, j = course.blocks[p].second;
+		float xpos = edge*(-nhor/2) + j*edge + edge/2;
+		float ypos = 10;
+		float zpos = edge*(-nvert/2) + i*edge + edge/2;
+
+		if(agent.posx + edge/4 > xpos - edge/2 &&
+				agent.posx - edge/4 < xpos + edge/2 &&
+				agent.posz + edge/4 > zpos - edge/2 &&
+				agent.posz - edge/4 < zpos + edge/2 &&
+				agent.posy - edge/2 <= ypos + edge/2
+		  ){
+			agent.posy = ypos + edge;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int agentOnBlock(const Course &course, const Agent &agent){
+	float edge = course.edge, nhor = course.nhor, nvert = course.nvert;
+	for(int p = 0;p<course.blocks.size();p++){
+		int i = course.blocks[p].first, j = course.blocks[p].second;
+		float xpos = edge*(-nhor/2) + j*edge + edge/2;
+		float ypos = 10;
+		float zpos = edge*(-nvert/2) + i*edge + edge/2;
+		if(agent.posx + edge/4 > xpos - edge/2 &&
+				agent.posx - edge/4 < xpos + edge/2 &&
+				agent.posz + edge/4 > zpos - edge/2 &&
+				agent.posz - edge/4 < zpos + edge/2 &&
+				agent.posy - edge/2 <= ypos + edge/2 &&
+				agent.posy - edge/2 >= ypos + edge/4
+		  ){
+			return p+1;
+		}
+	}
+	for(int p = 0;p<course.imblocks.size();p++){
+		int i = course.imblocks[p].first, j = course.imblocks[p].second;
+		float xpos = edge*(-nhor/2) + j*edge + edge/2;
+		float zpos = edge*(-nvert/2) + i*edge + edge/2;
+		if(agent.posx + edge/4 > xpos - edge/2 &&
+				agent.posx - edge/4 < xpos + edge/2 &&
+				agent.posz + edge/4 > zpos - edge/2 &&
+				agent.posz - edge/4 < zpos + edge/2
+		  ){
+			return 100 + p+1;
+		}
+	}
+	return 0;
+}
+
+static void checkFall(const Course &course, Agent &agent){
+	float edge = course.edge, nhor = course.nhor, nvert = course.nvert;
+	const vector<pair<int,int> > &impos = course.impos;
+	if(agent.posx < edge *(-nhor/2) - edge/4 || agent.posx > edge*(-nhor/2) +(nhor)*edge + edge/4 ||
+			agent.posz > edge*(-nvert/2) + nvert * edge + edge/4 || agent.posz < edge *(-nvert/2) - edge/4){
+		agent.posy--;
+		return;
+	}
+	for(int p=0;p<course.holes.size();p++){
+		int i = course.holes[p].first;
+		int j = course.holes[p].second;
+		if(agent.posz >= edge*(-nhor/2)+i*edge + edge/4 && agent.posz <= edge*(-nhor/2) + (i+1)*edge - edge/4 &&
+				agent.posx >= edge*(-nvert/2) + j*edge + edge/4 && agent.posx <= edge*(-nvert/2) + (j+1)*edge -edge/4){
+			agent.posy--;
+			return;
+		}
+	}
+	int onBlock = agentOnBlock(course, agent);
+	if(onBlock){
+		agent.falling = 0;
+		agent.speedy = 0;
+		if(onBlock<=100){
+			agent.posy = 10 + edge;
+			return;
+		}
+		else if((agent.posy - edge/2 >= impos[onBlock - 100 -1].first || agent.posy + edge/2 <= impos[onBlock - 100 - 1].first - edge)){
+			int i = course.imblocks[onBlock - 100 - 1].first, j = course.imblocks[onBlock - 100 - 1].second;
+			float xpos = edge*(-nhor/2) + j*edge + edge/2;
+			float zpos = edge*(-nvert/2) + i*edge + edge/2;
+			if(agent.posx - edge/4 > xpos - edge/2 &&
+					agent.posx + edge/4 < xpos + edge/2 &&
+					agent.posz - edge/4 > zpos - edge/2 &&
+					agent.posz + edge/4 < zpos + edge/2)
+			agent.posy--;
+			return;
+		}
+		else{
+			agent.posy = impos[onBlock - 100 - 1].first + edge/2;
+			return;
+		}
+	}
+	else if(!agentOnGround(course, agent))
+		agent.posy--;
+}
+
+static void turnAgent(Agent &agent){
+	if(agent.turn_right)
+		agent.angle += 1;
+	if(agent.turn_left)
+		agent.angle -= 1;
+}
+
+int jumpAgent(const Course &course, Agent &agent){
+	if(!agentOnGround(course, agent) && !agentOnBlock(course, agent))
+		return 0;
+	agent.speedy = 5, agent.jump = 1;
+	return 1;
+}
+
+static void riseAgent(const Course &course, Agent &agent){
+	float edge = course.edge;
+	if(agent.jump == 1){
+		agent.posy += agent.speedy;
+		int onBlock = agentOnBlock(course, agent);
+		if(onBlock)
+			if(onBlock<=100 ||
+					(onBlock > 100 && agent.posy - edge/2 <= course.impos[onBlock - 100 -1].first)||
+					agentOnGround(course, agent)){
+				agent.speedy = 0;
+				agent.jump = 0;
+			}
+			else
+				agent.speedy -= 0.5;
+		else
+			if(agentOnGround(course, agent))
+				agent.speedy = 0,agent.jump = 0;
+			else
+				agent.speedy -= 0.5;
+	}
+}
+
+/* Sweep the box [minx,maxx]x[minz,maxz] by (dx,dz) against the box
+   [bminx,bmaxx]x[bminz,bmaxz]. Returns the entry time in [0,1] and the
+   contact normal, or a value > 1 and a zero normal if there is no hit
+   within this move.
+   Boxes that already overlap are ignored so an agent can always walk out. */
+static float sweepBox(float minx, float maxx, float minz, float maxz, float dx, float dz,
+		float bminx, float bmaxx, float bminz, float bmaxz, float &nx, float &nz)
+{
+	nx = nz = 0;
+	if(maxx > bminx && minx < bmaxx && maxz > bminz && minz < bmaxz)
+		return 2;
+
+	float entryx, exitx, entryz, exitz;
+	if(dx > 0)
+		entryx = (bminx - maxx) / dx, exitx = (bmaxx - minx) / dx;
+	else if(dx < 0)
+		entryx = (bmaxx - minx) / dx, exitx = (bminx - maxx) / dx;
+	else if(maxx > bminx && minx < bmaxx)
+		entryx = -INFINITY, exitx = INFINITY;
+	else
+		return 2;
+	if(dz > 0)
+		entryz = (bminz - maxz) / dz, exitz = (bmaxz - minz) / dz;
+	else if(dz < 0)
+		entryz = (bmaxz - minz) / dz, exitz = (bminz - maxz) / dz;
+	else if(maxz > bminz && minz < bmaxz)
+		entryz = -INFINITY, exitz = INFINITY;
+	else
+		return 2;
+
+	float entry = max(entryx, entryz), leave = min(exitx, exitz);
+	if(entry > leave || entry < 0 || entry > 1)
+		return 2;
+	if(entryx > entryz)
+		nx = dx > 0 ? -1 : 1, nz = 0;
+	else
+		nx = 0, nz = dz > 0 ? -1 : 1;
+	return entry;
+}
+
+AgentSweep sweepAgent(const Course &course, const Agent &agent, float dx, float dz)
+{
+	float edge = course.edge;
+	float half = edge/4;
+	AgentSweep hit;
+	hit.toi = 1;
+	hit.nx = hit.nz = 0;
+
+	// Only the cells touched by the swept box can hold something we hit
+	float minx = agent.posx - half + min(dx, 0.0f), maxx = agent.posx + half + max(dx, 0.0f);
+	float minz = agent.posz - half + min(dz, 0.0f), maxz = agent.posz + half + max(dz, 0.0f);
+	int j0 = max(course.cellJ(minx), 0), j1 = min(course.cellJ(maxx), COURSE_CELLS - 1);
+	int i0 = max(course.cellI(minz), 0), i1 = min(course.cellI(maxz), COURSE_CELLS - 1);
+
+	for(int i=i0;i<=i1;i++)
+		for(int j=j0;j<=j1;j++){
+			float ypos;
+			char c = course.gamemat[i][j];
+			if(c == 'B')
+				ypos = 10;
+			else if(c >= '0' && c <= '9' && course.imindex[i][j] >= 0){
+				int p = course.imindex[i][j];
+				if(course.impos[p].first <= 0)
+					continue;
+				ypos = course.impos[p].first - edge/2;
+			}
+			else
+				continue;
+			if(!(agent.posy - edge/4 < ypos + edge/2 && agent.posy + edge/4 > ypos - edge/2))
+				continue;
+
+			float xpos = course.cellX(j), zpos = course.cellZ(i);
+			float nx, nz;
+			float toi = sweepBox(agent.posx - half, agent.posx + half, agent.posz - half, agent.posz + half, dx, dz,
+					xpos - edge/2, xpos + edge/2, zpos - edge/2, zpos + edge/2, nx, nz);
+			if(toi < hit.toi)
+				hit.toi = toi, hit.nx = nx, hit.nz = nz;
+		}
+	return hit;
+}
+
+void slideAgent(const Course &course, Agent &agent, float dx, float dz)
+{
+	// A slide can turn into at most one more contact per axis
+	for(int pass=0;pass<3 && (dx != 0 || dz != 0);pass++){
+		AgentSweep hit = sweepAgent(course, agent, dx, dz);
+		if(hit.toi >= 1){
+			agent.posx += dx;
+			agent.posz += dz;
+			return;
+		}
+		// Stop just short of the contact and keep the tangential part of the rest
+		float t = max(hit.toi - SWEEP_SKIN / sqrtf(dx*dx + dz*dz), 0.0f);
+		agent.posx += dx * t;
+		agent.posz += dz * t;
+		float rest = 1 - t;
+		dx *= rest;
+		dz *= rest;
+		float into = dx * hit.nx + dz * hit.nz;
+		dx -= into * hit.nx;
+		dz -= into * hit.nz;
+	}
+}
+
+void moveAgent(const Course &course, Agent &agent){
+	turnAgent(agent);
+	if(agent.jump == 0)checkFall(course, agent);
+	riseAgent(course, agent);
+	int onBlock = agentOnBlock(course, agent);
+	// Rotating blocks carry whoever stands on them
+	if(onBlock && onBlock <= 100){
+		agent.angle--;
+	}
+	if(agent.falling)
+		return;
+	float c = cos(agent.angle*M_PI/180.0f), s = sin(agent.angle*M_PI/180.0f);
+	float forward = agent.movefront - agent.moveback, sideways = agent.moveright - agent.moveleft;
+	float dx = (s * forward + c * sideways) * agent.speed;
+	float dz = (-c * forward + s * sideways) * agent.speed;
+	slideAgent(course, agent, dx, dz);
+}
+
+/* Small LCG so every agent has its own deterministic stream */
+static unsigned int nextRandom(unsigned int &seed)
+{
+	seed = seed * 1103515245u + 12345u;
+	return (seed >> 16) & 0x7fff;
+}
+
+void thinkAgent(const Course &course, Agent &agent)
+{
+	if(agent.posy < RESPAWN_DEPTH){
+		agent.posx = agent.spawnx;
+		agent.posz = agent.spawnz;
+		agent.posy = 10;
+		agent.speedy = 0;
+		agent.jump = 0;
+	}
+	if(--agent.think_ticks > 0)
+		return;
+	agent.think_ticks = 30 + nextRandom(agent.seed) % 90;
+	unsigned int r = nextRandom(agent.seed);
+	agent.movefront = (r % 4) != 0;
+	agent.moveback = 0;
+	agent.moveleft = (r % 7) == 1;
+	agent.moveright = (r % 7) == 2;
+	agent.turn_left = ((r >> 3) % 3) == 0;
+	agent.turn_right = ((r >> 3) % 3) == 1;
+	if((r >> 5) % 5 == 0)
+		jumpAgent(course, agent);
+}
+
+void spawnAgents(const Course &course, vector<Agent> &agents, int count, unsigned int seed)
+{
+	vector<pair<int,int> > floor;
+	for(int i=0;i<course.nvert;i++)
+		for(int j=0;j<course.nhor;j++)
+			if(course.gamemat[i][j] == '.')
+				floor.push_back(make_pair(i,j));
+	agents.resize(count);
+	if(floor.empty())
+		return;
+	for(int a=0;a<count;a++){
+		Agent &agent = agents[a];
+		agent.seed = seed + a * 2654435761u;
+		const pair<int,int> &cell = floor[nextRandom(agent.seed) % floor.size()];
+		placeAgent(course, agent, cell.first, cell.second);
+		agent.angle = nextRandom(agent.seed) % 360;
+		agent.think_ticks = 0;
+	}
+}
+
+void updateAgents(JobSystem &jobs, const Course &course, vector<Agent> &agents)
+{
+	Agent *data = agents.data();
+	jobs.parallelFor(agents.size(), AGENT_GRAIN, [&course, data](int begin, int end){
+		for(int a=begin;a<end;a++){
+			thinkAgent(course, data[a]);
+			moveAgent(course, data[a]);
+		}
+	});
+}
@@ -0,0 +1,66 @@
+#ifndef AGENT_H
+#define AGENT_H
+
+#include <vector>
+
+#include "course.h"
+
+class JobSystem;
+
+/* Kinematic state and input of one adventurer.
+ * The player is an agent driven by the keyboard; crowd agents drive
+ * their own input flags from think(). */
+struct Agent {
+	float posx, posy, posz;
+	float angle;
+	float speed; // walking distance per tick
+	float speedy;
+	int jump, falling;
+
+	// Input for this tick
+	int movefront, moveback, moveleft, moveright;
+	int turn_left, turn_right;
+
+	// Autonomous agents only
+	unsigned int seed;
+	int think_ticks;
+	float spawnx, spawnz;
+
+	Agent();
+};
+
+/* Put the agent on the start cell (bottom left corner of the course) */
+void resetAgent(const Course &course, Agent &agent);
+/* Put the agent on cell (i,j) */
+void placeAgent(const Course &course, Agent &agent, int i, int j);
+
+int agentOnGround(const Course &course, Agent &agent);
+int agentOnBlock(const Course &course, const Agent &agent);
+/* Start a jump if the agent is standing on something. Returns 1 if it jumped. */
+int jumpAgent(const Course &course, Agent &agent);
+
+/* First contact of the agent's box moving by (dx,dz) against the blocks of the course.
+   toi is the fraction of the move before contact (1 if nothing is hit) and
+   (nx,nz) the normal of the face that was hit. */
+struct AgentSweep {
+	float toi;
+	float nx, nz;
+};
+AgentSweep sweepAgent(const Course &course, const Agent &agent, float dx, float dz);
+/* Move the agent by (dx,dz), sliding along any block it runs into.
+   Correct for displacements of any length, so large steps cannot tunnel. */
+void slideAgent(const Course &course, Agent &agent, float dx, float dz);
+
+/* Advance one tick: turning, falling, jumping and walking with block collisions */
+void moveAgent(const Course &course, Agent &agent);
+
+/* Randomised input for an autonomous agent */
+void thinkAgent(const Course &course, Agent &agent);
+
+/* Spawn count autonomous agents on random floor cells */
+void spawnAgents(const Course &course, std::vector<Agent> &agents, int count, unsigned int seed);
+
+/* think + move every agent in parallel. The course is only read. */
+void updateAgents(JobSystem &jobs, const Course &course, std::vector<Agent> &agents);
+
+#endif
@@ -0,0 +1,71 @@
+#include <algorithm>
+
+#include "assets.h"
+
+using namespace std;
+
+void AssetSet::configure(const TextureCache *textureCache, const TextureQuality *textureQuality)
+{
+	cache = textureCache && textureCache->isOpen() ? textureCache : NULL;
+	quality = textureQuality;
+}
+
+int AssetSet::declare(const char *filename)
+{
+	for(int a=0;a<aliases.size();a++)
+		if(aliases[a].first == filename)
+			return aliases[a].second;
+	for(int a=0;a<assets.size();a++)
+		if(assets[a].filename == filename)
+			return a;
+	assets.push_back(Asset());
+	assets.back().filename = filename;
+	assets.back().texture = 0;
+	assets.back().failed = 0;
+	return assets.size() - 1;
+}
+
+void AssetSet::load(const vector<int> &ids)
+{
+	vector<GLuint> names(ids.size(), 0);
+	vector<TextureRequest> requests(ids.size());
+	for(int i=0;i<ids.size();i++){
+		requests[i].filename = assets[ids[i]].filename.c_str();
+		requests[i].texture = &names[i];
+		requests[i].base_level = 0;
+	}
+	if(quality){
+		// Whatever is resident already, from earlier batches or first uses, is spent
+		TextureQuality remaining = *quality;
+		size_t used = resources.residentBytes(RESOURCE_TEXTURE);
+		if(quality->budget())
+			remaining.setBudget(used < quality->budget() ? quality->budget() - used : 1);
+		planTextures(&requests[0], requests.size(), remaining, cache);
+	}
+	loadTextures(jobs, &requests[0], requests.size(), cache);
+	for(int i=0;i<ids.size();i++){
+		Asset &asset = assets[ids[i]];
+		asset.handle = resources.adoptTexture(requests[i].filename, names[i]);
+		asset.texture = asset.handle.valid() ? resources.textureID(asset.handle) : 0;
+		asset.failed = !asset.handle.valid();
+	}
+}
+
+void AssetSet::prefetch(const vector<int> &ids)
+{
+	vector<int> missing;
+	for(int i=0;i<ids.size();i++)
+		if(!assets[ids[i]].handle.valid() && !assets[ids[i]].failed && find(missing.begin(), missing.end(), ids[i]) == missing.end())
+			missing.push_back(ids[i]);
+	if(!missing.empty())
+		load(missing);
+}
+
+void AssetSet::keepOnly(const vector<int> &ids)
+{
+	for(int a=0;a<assets.size();a++)
+		if(find(ids.begin(), ids.end(), a) == ids.end()){
+			assets[a].handle.reset();
+			assets[a].texture = 0;
+		}
+}
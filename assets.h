@@ -0,0 +1,65 @@
+#ifndef ASSETS_H
+#define ASSETS_H
+
+#include <string>
+#include <vector>
+#include <utility>
+
+#include <glad/glad.h>
+
+#include "resources.h"
+#include "textures.h"
+
+class JobSystem;
+
+/* Every texture the game may draw with, by id. Declaring one loads nothing:
+ * it is loaded on first use, or ahead of time in parallel with the rest of
+ * a level's set, and released again once the set it belongs to is dropped. */
+class AssetSet {
+	public:
+		AssetSet(ResourceManager &resources, JobSystem &jobs) : resources(resources), jobs(jobs), cache(NULL), quality(NULL) {}
+
+		/* Texture cache and quality tier used for every load, both optional */
+		void configure(const TextureCache *textureCache, const TextureQuality *textureQuality);
+
+		/* Id of filename, the same id for the same file */
+		int declare(const char *filename);
+		/* Make declare(filename) return id, e.g. for an image packed into an atlas */
+		void alias(const char *filename, int id) { aliases.push_back(std::make_pair(std::string(filename), id)); }
+		const char *filename(int id) const { return assets[id].filename.c_str(); }
+		int resident(int id) const { return assets[id].handle.valid(); }
+
+		/* GL name of asset id, loading it right now if it isn't resident */
+		GLuint texture(int id)
+		{
+			if(!assets[id].handle.valid() && !assets[id].failed){
+				std::vector<int> one(1, id);
+				load(one);
+			}
+			return assets[id].texture;
+		}
+
+		/* Load every asset of ids that isn't resident, decoding in parallel */
+		void prefetch(const std::vector<int> &ids);
+		/* Drop the references to every asset not in ids; whatever nothing else holds is freed */
+		void keepOnly(const std::vector<int> &ids);
+
+	private:
+		struct Asset {
+			std::string filename;
+			ResourceHandle handle;
+			GLuint texture;
+			int failed; // don't retry a file that would not load
+		};
+
+		void load(const std::vector<int> &ids);
+
+		ResourceManager &resources;
+		JobSystem &jobs;
+		const TextureCache *cache;
+		const TextureQuality *quality;
+		std::vector<Asset> assets;
+		std::vector<std::pair<std::string, int> > aliases;
+};
+
+#endif
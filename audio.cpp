@@ -0,0 +1,432 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#include <mpg123.h>
+
+#include "audio.h"
+#include "pack.h"
+#include "texcache.h"
+#include "trace.h"
+
+using namespace std;
+
+PcmRing::PcmRing(int frames) : head(0), tail(0)
+{
+	unsigned size = 1;
+	while(size < (unsigned)frames)
+		size <<= 1;
+	mask = size - 1;
+	samples.resize(size * AUDIO_CHANNELS);
+}
+
+int PcmRing::available() const
+{
+	return head.load(memory_order_acquire) - tail.load(memory_order_acquire);
+}
+
+int PcmRing::write(const short *frames, int count)
+{
+	unsigned h = head.load(memory_order_relaxed);
+	unsigned t = tail.load(memory_order_acquire);
+	count = min(count, (int)(capacity() - (h - t)));
+	// Up to the end of the storage, then the rest from the start
+	int first = min(count, (int)(capacity() - (h & mask)));
+	memcpy(&samples[(h & mask) * AUDIO_CHANNELS], frames, first * AUDIO_CHANNELS * sizeof(short));
+	memcpy(&samples[0], frames + first * AUDIO_CHANNELS, (count - first) * AUDIO_CHANNELS * sizeof(short));
+	head.store(h + count, memory_order_release);
+	return count;
+}
+
+int PcmRing::read(short *frames, int count)
+{
+	unsigned t = tail.load(memory_order_relaxed);
+	unsigned h = head.load(memory_order_acquire);
+	count = min(count, (int)(h - t));
+	int first = min(count, (int)(capacity() - (t & mask)));
+	memcpy(frames, &samples[(t & mask) * AUDIO_CHANNELS], first * AUDIO_CHANNELS * sizeof(short));
+	memcpy(frames + first * AUDIO_CHANNELS, &samples[0], (count - first) * AUDIO_CHANNELS * sizeof(short));
+	tail.store(t + count, memory_order_release);
+	return count;
+}
+
+/* mpg123 reader over a span of the asset pack */
+struct MemoryReader {
+	AssetSpan span;
+	size_t pos;
+};
+
+static ssize_t readMemory (void* handle, void* buffer, size_t count)
+{
+	MemoryReader* reader = (MemoryReader*)handle;
+	count = min(count, reader->span.size - reader->pos);
+	memcpy(buffer, reader->span.data + reader->pos, count);
+	reader->pos += count;
+	return count;
+}
+
+static off_t seekMemory (void* handle, off_t offset, int whence)
+{
+	MemoryReader* reader = (MemoryReader*)handle;
+	off_t base = whence == SEEK_SET ? 0 : whence == SEEK_CUR ? reader->pos : reader->span.size;
+	if(base + offset < 0 || base + offset > (off_t)reader->span.size)
+		return -1;
+	reader->pos = base + offset;
+	return reader->pos;
+}
+
+/* A tone gliding from f0 to f1 Hz, with a 5ms attack and an exponential decay */
+static vector<float> sweep(float seconds, float f0, float f1, float decay, float gain)
+{
+	vector<float> samples(seconds * AUDIO_RATE);
+	double phase = 0;
+	for(int i=0;i<samples.size();i++){
+		float t = (float)i / AUDIO_RATE;
+		float attack = min(1.0f, t / 0.005f);
+		samples[i] = gain * attack * expf(-decay * t) * sinf(phase);
+		phase += 2 * M_PI * (f0 + (f1 - f0) * t / seconds) / AUDIO_RATE;
+	}
+	return samples;
+}
+
+/* A seamless loop of seconds: whole cycles of each partial (frequency, gain),
+   with a tremolo of tremolo Hz */
+static vector<float> loop(float seconds, const float (*partials)[2], int count, float tremolo, float depth)
+{
+	vector<float> samples(seconds * AUDIO_RATE);
+	for(int i=0;i<samples.size();i++){
+		double t = (double)i / AUDIO_RATE, value = 0;
+		for(int p=0;p<count;p++)
+			value += partials[p][1] * sin(2 * M_PI * partials[p][0] * t);
+		samples[i] = value * (1 - depth + depth * 0.5 * (1 + cos(2 * M_PI * tremolo * t)));
+	}
+	return samples;
+}
+
+static void add(vector<float> &sound, const vector<float> &part, float at)
+{
+	size_t start = at * AUDIO_RATE;
+	if(sound.size() < start + part.size())
+		sound.resize(start + part.size());
+	for(size_t i=0;i<part.size();i++)
+		sound[start + i] += part[i];
+}
+
+MusicStream::MusicStream() : looping(0), ring(AUDIO_RING_FRAMES), stopping(false), decoded(true), decode_usec(0),
+	mh(NULL), reader(NULL), cache_pos(0)
+{
+}
+
+int MusicStream::openCache(const char *track)
+{
+	// Only a cache decoded from exactly this track; the pack already knows its hash
+	unsigned long long hash;
+	AssetSpan span;
+	if(!findAsset(track, span, &hash) && !hashFile(track, hash))
+		return 0;
+	return cache.open((string(track) + PCMCACHE_SUFFIX).c_str(), hash, AUDIO_RATE, AUDIO_CHANNELS);
+}
+
+int MusicStream::openDecoder(const char *track)
+{
+	int err;
+	mh = mpg123_new(NULL, &err);
+	if(!mh)
+		return 0;
+	// Let mpg123 resample and remix, so the ring and device have one format
+	mpg123_format_none(mh);
+	mpg123_format(mh, AUDIO_RATE, MPG123_STEREO, MPG123_ENC_SIGNED_16);
+	reader = new MemoryReader();
+	if(findAsset(track, reader->span)){
+		reader->pos = 0;
+		mpg123_replace_reader_handle(mh, readMemory, seekMemory, NULL);
+		return mpg123_open_handle(mh, reader) == MPG123_OK;
+	}
+	return mpg123_open(mh, track) == MPG123_OK;
+}
+
+int MusicStream::open(const char *track, int loop)
+{
+	TRACE_SCOPE("open music", track);
+	close();
+	if(!openCache(track) && !openDecoder(track)){
+		close();
+		return 0;
+	}
+	name = track;
+	looping = loop;
+	cache_pos = 0;
+	stopping = false;
+	// Nothing to decode when playing from the cache
+	decoded = cache.isOpen() && !looping;
+	if(!cache.isOpen())
+		decoder = std::thread(&MusicStream::decodeLoop, this);
+	return 1;
+}
+
+void MusicStream::close()
+{
+	stopping = true;
+	if(decoder.joinable())
+		decoder.join();
+	if(mh){
+		mpg123_close(mh);
+		mpg123_delete(mh);
+		mh = NULL;
+	}
+	delete reader;
+	reader = NULL;
+	cache.close();
+	name.clear();
+	ring.clear();
+	decoded = true;
+}
+
+int MusicStream::read(short *frames, int count)
+{
+	if(!cache.isOpen())
+		return ring.read(frames, count);
+	int got = 0;
+	while(got < count){
+		if(cache_pos == cache.frames()){
+			if(!looping || !cache.frames())
+				break;
+			cache_pos = 0;
+		}
+		int n = min((unsigned long long)(count - got), cache.frames() - cache_pos);
+		memcpy(frames + got * AUDIO_CHANNELS, cache.samples() + cache_pos * AUDIO_CHANNELS, n * AUDIO_CHANNELS * sizeof(short));
+		cache_pos += n;
+		got += n;
+	}
+	return got;
+}
+
+void MusicStream::decodeLoop()
+{
+	traceThreadName("audio decode");
+	vector<unsigned char> buffer(mpg123_outblock(mh));
+	size_t done;
+	int err;
+	long long since_start = 0;
+	do{
+		chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+		err = mpg123_read(mh, &buffer[0], buffer.size(), &done);
+		decode_usec += chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - begin).count();
+		const short *frames = (const short*)&buffer[0];
+		int count = done / (AUDIO_CHANNELS * sizeof(short));
+		since_start += count;
+		// Block only by napping while the ring is full, the output side never waits on us
+		while(count && !stopping){
+			int written = ring.write(frames, count);
+			frames += written * AUDIO_CHANNELS;
+			count -= written;
+			if(count)
+				this_thread::sleep_for(chrono::milliseconds(5));
+		}
+		// Straight back to the start, the ring hides the seek
+		if(err == MPG123_DONE && looping && since_start && mpg123_seek(mh, 0, SEEK_SET) >= 0){
+			err = MPG123_OK;
+			since_start = 0;
+		}
+	} while((err == MPG123_OK || err == MPG123_NEW_FORMAT) && !stopping);
+	decoded = true;
+}
+
+AudioSystem::AudioSystem() : current(0), fade_to(-1), fade_frames(1), cut_fade(false), stopping(false),
+	block_count(0), underrun_count(0), underrun_frames(0), mix_usec(0)
+{
+	mpg123_init();
+	// In SOUND_* order
+	mixer.addSound(sweep(0.15f, 300, 700, 12, 0.4f));
+	vector<float> chime = sweep(0.08f, 988, 988, 0, 0.3f);
+	add(chime, sweep(0.35f, 1319, 1319, 9, 0.3f), 0.08f);
+	mixer.addSound(chime);
+	vector<float> shimmer = sweep(1.2f, 220, 880, 1.5f, 0.25f);
+	add(shimmer, sweep(1.2f, 330, 1320, 1.5f, 0.15f), 0);
+	add(shimmer, sweep(1.0f, 445, 1780, 2, 0.1f), 0.2f);
+	mixer.addSound(shimmer);
+	mixer.addSound(sweep(0.8f, 900, 90, 3, 0.4f));
+	// Frequencies in whole Hz over a second long loop, so each wraps without a click
+	const float hum[][2] = { {55, 0.12f}, {110, 0.08f}, {165, 0.03f} };
+	mixer.addSound(loop(1, hum, 3, 2, 0.3f));
+	const float whir[][2] = { {180, 0.06f}, {361, 0.04f}, {542, 0.02f} };
+	mixer.addSound(loop(1, whir, 3, 8, 0.6f));
+	const float drone[][2] = { {220, 0.06f}, {277, 0.05f}, {330, 0.05f}, {441, 0.02f} };
+	mixer.addSound(loop(1, drone, 4, 1, 0.5f));
+}
+
+AudioSystem::~AudioSystem()
+{
+	stop();
+	mpg123_exit();
+}
+
+int AudioSystem::start(const char *track)
+{
+	TRACE_SCOPE("audio start", track);
+	stop();
+	if(!sink.open(AUDIO_RATE, AUDIO_CHANNELS)){
+		stop();
+		return 0;
+	}
+	// Without the track the sink still gets effects
+	if(!music[0].open(track, !sink.fast()))
+		fprintf(stderr, "Unable to open %s\n", track);
+	current = 0;
+	fade_to = -1;
+	cut_fade = false;
+	stopping = false;
+	output = std::thread(&AudioSystem::outputLoop, this);
+	return 1;
+}
+
+void AudioSystem::stop()
+{
+	stopping = true;
+	if(output.joinable())
+		output.join();
+	music[0].close();
+	music[1].close();
+	sink.close();
+}
+
+int AudioSystem::playMusic(const char *track, float fade)
+{
+	if(fade_to.load(memory_order_acquire) < 0 && music[current].track() == track)
+		return 1;
+	TRACE_SCOPE("playMusic", track);
+	// The output thread finishes a cut fade within a block
+	if(fade_to.load(memory_order_acquire) >= 0){
+		cut_fade = true;
+		while(output.joinable() && fade_to.load(memory_order_acquire) >= 0)
+			this_thread::sleep_for(chrono::milliseconds(1));
+		fade_to = -1;
+		cut_fade = false;
+		if(music[current].track() == track)
+			return 1;
+	}
+	int next = 1 - current;
+	if(!music[next].open(track, !sink.fast())){
+		fprintf(stderr, "Unable to open %s\n", track);
+		return 0;
+	}
+	if(!output.joinable()){
+		current = next;
+		return 1;
+	}
+	fade_frames = max(1, (int)(fade * AUDIO_RATE));
+	fade_to.store(next, memory_order_release);
+	return 1;
+}
+
+int AudioSystem::readMusic(MusicStream &stream, short *frames, int count)
+{
+	int finished = stream.finished();
+	int got = stream.read(frames, count);
+	// Nothing waits on an unthrottled sink, so it waits for the decoder instead
+	while(sink.fast() && got < count && !finished && !stopping){
+		this_thread::sleep_for(chrono::milliseconds(1));
+		finished = stream.finished();
+		got += stream.read(frames + got * AUDIO_CHANNELS, count - got);
+	}
+	if(got < count){
+		memset(frames + got * AUDIO_CHANNELS, 0, (count - got) * AUDIO_CHANNELS * sizeof(short));
+		if(!finished && !stopping){
+			underrun_count++;
+			underrun_frames += count - got;
+		}
+	}
+	return got;
+}
+
+void AudioSystem::outputLoop()
+{
+	traceThreadName("audio output");
+	typedef chrono::steady_clock Clock;
+	const Clock::duration period = chrono::microseconds(AUDIO_BLOCK * 1000000LL / AUDIO_RATE);
+	short block[AUDIO_BLOCK * AUDIO_CHANNELS], incoming[AUDIO_BLOCK * AUDIO_CHANNELS];
+	float mix[AUDIO_BLOCK * AUDIO_CHANNELS], fading[AUDIO_BLOCK * AUDIO_CHANNELS];
+	// Wait for a full block before the first write, so startup is not an underrun
+	while(!stopping && !music[current].ready())
+		this_thread::sleep_for(chrono::milliseconds(1));
+	Clock::time_point deadline = Clock::now();
+	int fade_pos = -1; // frames into the fade, -1 while not fading
+	while(!stopping){
+		int from = current, to = fade_to.load(memory_order_acquire);
+		if(to >= 0 && cut_fade){
+			current = to;
+			fade_to.store(-1, memory_order_release);
+			fade_pos = -1;
+			continue;
+		}
+		// Hold the fade until the new track has its first block
+		if(to >= 0 && fade_pos < 0 && music[to].ready())
+			fade_pos = 0;
+
+		int got = readMusic(music[from], block, AUDIO_BLOCK);
+		if(stopping)
+			break;
+
+		Clock::time_point begin = Clock::now();
+		if(fade_pos >= 0){
+			got += readMusic(music[to], incoming, AUDIO_BLOCK);
+			pcmToFloat(mix, block, AUDIO_BLOCK * AUDIO_CHANNELS);
+			pcmToFloat(fading, incoming, AUDIO_BLOCK * AUDIO_CHANNELS);
+			// Equal power curves, interpolated linearly across the block
+			int length = fade_frames;
+			float x0 = min(1.0f, (float)fade_pos / length), x1 = min(1.0f, (float)(fade_pos + AUDIO_BLOCK) / length);
+			float out0 = cosf(x0 * (float)M_PI / 2), out1 = cosf(x1 * (float)M_PI / 2);
+			float in0 = sinf(x0 * (float)M_PI / 2), in1 = sinf(x1 * (float)M_PI / 2);
+			for(int i=0;i<AUDIO_BLOCK;i++){
+				float t = (float)i / AUDIO_BLOCK;
+				float out = out0 + (out1 - out0) * t, in = in0 + (in1 - in0) * t;
+				for(int c=0;c<AUDIO_CHANNELS;c++)
+					mix[i*AUDIO_CHANNELS + c] = mix[i*AUDIO_CHANNELS + c] * out + fading[i*AUDIO_CHANNELS + c] * in;
+			}
+			mixEffects(mix);
+			floatToPcm(block, mix, AUDIO_BLOCK * AUDIO_CHANNELS);
+			fade_pos += AUDIO_BLOCK;
+			if(fade_pos >= length){
+				current = to;
+				fade_to.store(-1, memory_order_release);
+				fade_pos = -1;
+			}
+		}
+		// Leave the music untouched unless there are effects to add
+		else if(mixer.pending() || mixer.activeVoices() || field.active()){
+			pcmToFloat(mix, block, AUDIO_BLOCK * AUDIO_CHANNELS);
+			mixEffects(mix);
+			floatToPcm(block, mix, AUDIO_BLOCK * AUDIO_CHANNELS);
+		}
+		Clock::time_point end = Clock::now();
+		mix_usec += chrono::duration_cast<chrono::microseconds>(end - begin).count();
+
+		// Pace the sinks that do not block by themselves; unthrottled ones
+		// too once the music is over, rather than churning out silence
+		if(!sink.blocking() && (!sink.fast() || (!got && music[current].finished()))){
+			deadline = max(deadline + period, end - period);
+			this_thread::sleep_until(deadline);
+		}
+		sink.write(block, AUDIO_BLOCK);
+		block_count++;
+	}
+}
+
+void AudioSystem::mixEffects(float *mix)
+{
+	mixer.mix(mix, AUDIO_BLOCK);
+	field.mix(mixer, mix, AUDIO_BLOCK);
+}
+
+void AudioSystem::report(FILE *out) const
+{
+	fprintf(out, "audio: %lld blocks of %d frames from the %s, %lld underruns (%lld frames of silence)\n",
+			blocks(), AUDIO_BLOCK, music[current].cached() ? "PCM cache" : "decoder", underruns(), underrunFrames());
+	fprintf(out, "audio: %lld voices stolen, %lld effects dropped\n", mixer.stolen(), mixer.dropped());
+	// Cost per block against the time the block lasts
+	double block_usec = AUDIO_BLOCK * 1e6 / AUDIO_RATE, n = max(blocks(), 1LL);
+	double decode_usec = music[0].decodeMicroseconds() + music[1].decodeMicroseconds();
+	fprintf(out, "audio: decode %.1f us/block (%.2f%%), mix %.1f us/block (%.2f%%)\n",
+			decode_usec / n, 100 * decode_usec / n / block_usec, mix_usec / n, 100 * mix_usec / n / block_usec);
+}
@@ -0,0 +1,169 @@
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "audiosink.h"
+#include "emitters.h"
+#include "mixer.h"
+#include "pcmcache.h"
+
+typedef struct mpg123_handle_struct mpg123_handle;
+struct MemoryReader;
+
+/* Everything is decoded to and played as interleaved 16-bit stereo at this rate */
+#define AUDIO_RATE 44100
+#define AUDIO_CHANNELS 2
+/* Frames handed to the device per write, about 23ms */
+#define AUDIO_BLOCK 1024
+/* Frames decoded ahead of the device, about 370ms */
+#define AUDIO_RING_FRAMES 16384
+
+/* Effects every AudioSystem can play, synthesized when it is created */
+#define SOUND_JUMP 0
+#define SOUND_TREASURE 1
+#define SOUND_PORTAL_OPEN 2
+#define SOUND_PORTAL_ENTER 3
+/* Loops for EmitterField */
+#define SOUND_HUM 4 // rotating blocks
+#define SOUND_WHIR 5 // oscillating blocks
+#define SOUND_DRONE 6 // open portal
+
+/* Lock-free ring of stereo frames for exactly one producer and one consumer.
+ * Each side only stores its own index, with release ordering after it has
+ * touched the samples, and loads the other's with acquire ordering. */
+class PcmRing {
+	public:
+		/* frames is rounded up to a power of two */
+		explicit PcmRing(int frames);
+
+		/* Producer: copy up to count frames in, returns how many fit */
+		int write(const short *frames, int count);
+		/* Consumer: copy up to count frames out, returns how many there were */
+		int read(short *frames, int count);
+
+		int available() const;
+		int space() const { return capacity() - available(); }
+		int capacity() const { return mask + 1; }
+		/* Only while neither side is running */
+		void clear() { head = tail = 0; }
+
+	private:
+		std::vector<short> samples;
+		unsigned mask;
+		alignas(64) std::atomic<unsigned> head; // frames written, producer only
+		alignas(64) std::atomic<unsigned> tail; // frames read, consumer only
+};
+
+/* Seconds a level's music takes to fade into the next one's */
+#define MUSIC_FADE 2.0f
+
+/* One track played in a loop, in bounded memory: decoded a chunk at a time
+ * into its own PcmRing by its own thread, or copied out of the mapping of
+ * its PcmCache if tools/pcmbake left one. Opened and closed on the game
+ * thread, read on the audio output thread. */
+class MusicStream {
+	public:
+		MusicStream();
+		~MusicStream() { close(); }
+
+		/* Start decoding track, from its PCM cache, the asset pack or the
+		   file, in that order of preference. Returns 0 if it cannot be read.
+		   Without loop the stream finishes at the end of the track. */
+		int open(const char *track, int loop);
+		void close();
+		int isOpen() const { return !name.empty(); }
+		const std::string &track() const { return name; }
+		int cached() const { return cache.isOpen(); }
+
+		/* Output thread: copy up to count frames out. Fewer come back only
+		   if the decoder fell behind or the stream has finished. */
+		int read(short *frames, int count);
+		/* No frames will come any more */
+		int finished() const { return decoded && (cache.isOpen() ? cache_pos == cache.frames() : !ring.available()); }
+		/* A whole block can be read without an underrun */
+		int ready() const { return decoded || cache.isOpen() || ring.available() >= AUDIO_BLOCK; }
+
+		long long decodeMicroseconds() const { return decode_usec; }
+
+	private:
+		MusicStream(const MusicStream&);
+		MusicStream &operator=(const MusicStream&);
+
+		int openCache(const char *track);
+		int openDecoder(const char *track);
+		void decodeLoop();
+
+		std::string name;
+		int looping;
+		PcmRing ring;
+		std::thread decoder;
+		std::atomic<bool> stopping, decoded;
+		std::atomic<long long> decode_usec;
+		mpg123_handle *mh;
+		MemoryReader *reader; // when the track is read from the asset pack
+		PcmCache cache;
+		unsigned long long cache_pos; // frames played from the cache, output thread only
+};
+
+/* Music and sound effects inside the game process.
+ * An output thread reads the music a block at a time, mixes the effects
+ * over it and hands it to an AudioSink, paced by the device or by sleeping
+ * for sinks without one. When the music runs dry mid-track the block is
+ * padded with silence and counted as an underrun. Effects and positional
+ * emitters are mixed over it on the same thread. Changing tracks fades
+ * between two MusicStreams, so at most two rings of music are in memory. */
+class AudioSystem {
+	public:
+		AudioSystem();
+		~AudioSystem();
+
+		/* Choose the sink before start(), see AudioSink. Returns 0 on a bad spec. */
+		int configure(const char *spec) { return sink.configure(spec); }
+
+		/* Open the sink and start playing music. Returns 0 if the sink could
+		   not be opened; without the track only effects play. Music loops,
+		   except on unthrottled sinks, so that rendering a track ends. */
+		int start(const char *music);
+		/* Stop every thread and close the sink */
+		void stop();
+
+		/* Game thread: fade over fade seconds into another track. Nothing
+		   changes if it is playing already; a fade under way is cut short.
+		   Returns 0 if the track cannot be read, leaving the music as it was. */
+		int playMusic(const char *track, float fade = MUSIC_FADE);
+
+		/* Start a SOUND_* effect; safe to call from the game thread while playing */
+		int play(int sound, float gain = 1, float pan = 0) { return mixer.play(sound, gain, pan); }
+		/* Positional loops, edited and published by the game thread */
+		EmitterField &emitters() { return field; }
+
+		long long blocks() const { return block_count; }
+		long long underruns() const { return underrun_count; }
+		long long underrunFrames() const { return underrun_frames; }
+		void report(FILE *out) const;
+
+	private:
+		void outputLoop();
+		int readMusic(MusicStream &stream, short *frames, int count);
+		void mixEffects(float *mix);
+
+		MusicStream music[2];
+		std::atomic<int> current; // stream being played
+		std::atomic<int> fade_to; // stream faded in, -1 when not fading
+		std::atomic<int> fade_frames;
+		std::atomic<bool> cut_fade;
+		Mixer mixer;
+		EmitterField field;
+		std::thread output;
+		std::atomic<bool> stopping;
+		std::atomic<long long> block_count, underrun_count, underrun_frames;
+		std::atomic<long long> mix_usec;
+		AudioSink sink;
+};
+
+#endif
@@ -0,0 +1,126 @@
+#include <cstring>
+
+#include <ao/ao.h>
+
+#include "audiosink.h"
+
+using namespace std;
+
+/* Canonical 44 byte header of a 16-bit PCM WAV file */
+struct WavHeader {
+	char riff[4];
+	unsigned riff_size;
+	char wave[4], fmt[4];
+	unsigned fmt_size;
+	unsigned short format, channels;
+	unsigned rate, byte_rate;
+	unsigned short block_align, bits;
+	char data[4];
+	unsigned data_size;
+};
+
+static void wavHeader(WavHeader &header, int rate, int channels, unsigned long long frames)
+{
+	unsigned data_size = frames * channels * sizeof(short);
+	memcpy(header.riff, "RIFF", 4);
+	header.riff_size = 36 + data_size;
+	memcpy(header.wave, "WAVE", 4);
+	memcpy(header.fmt, "fmt ", 4);
+	header.fmt_size = 16;
+	header.format = 1; // PCM
+	header.channels = channels;
+	header.rate = rate;
+	header.byte_rate = rate * channels * sizeof(short);
+	header.block_align = channels * sizeof(short);
+	header.bits = 16;
+	memcpy(header.data, "data", 4);
+	header.data_size = data_size;
+}
+
+AudioSink::AudioSink() : sink_mode(SINK_AO), unthrottled(0), sink_rate(0), sink_channels(0), device(NULL), file(NULL), frames_written(0)
+{
+}
+
+int AudioSink::configure(const char *spec)
+{
+	if(!spec || !*spec)
+		return 0;
+	if(!strcmp(spec, "ao")){
+		sink_mode = SINK_AO;
+		unthrottled = 0;
+	}
+	else if(!strcmp(spec, "null") || !strcmp(spec, "null:fast")){
+		sink_mode = SINK_NULL;
+		unthrottled = spec[4] != 0;
+	}
+	else if(!strncmp(spec, "wav:", 4)){
+		spec += 4;
+		unthrottled = !strncmp(spec, "fast:", 5);
+		if(unthrottled)
+			spec += 5;
+		if(!*spec)
+			return 0;
+		sink_mode = SINK_WAV;
+		path = spec;
+	}
+	else
+		return 0;
+	return 1;
+}
+
+int AudioSink::open(int rate, int channels)
+{
+	close();
+	sink_rate = rate;
+	sink_channels = channels;
+	frames_written = 0;
+	if(sink_mode == SINK_AO){
+		ao_initialize();
+		ao_sample_format format;
+		format.bits = 16;
+		format.rate = rate;
+		format.channels = channels;
+		format.byte_format = AO_FMT_NATIVE;
+		format.matrix = 0;
+		device = ao_open_live(ao_default_driver_id(), &format, NULL);
+		if(!device)
+			ao_shutdown();
+		return device != NULL;
+	}
+	if(sink_mode == SINK_WAV){
+		file = fopen(path.c_str(), "wb");
+		if(!file)
+			return 0;
+		// Sizes are filled in by close()
+		WavHeader header;
+		wavHeader(header, rate, channels, 0);
+		fwrite(&header, sizeof(header), 1, file);
+	}
+	return 1;
+}
+
+void AudioSink::write(const short *frames, int count)
+{
+	if(device)
+		ao_play(device, (char*)frames, count * sink_channels * sizeof(short));
+	else if(file)
+		fwrite(frames, sizeof(short) * sink_channels, count, file);
+	frames_written += count;
+}
+
+void AudioSink::close()
+{
+	if(device){
+		ao_close(device);
+		ao_shutdown();
+		device = NULL;
+	}
+	if(file){
+		WavHeader header;
+		wavHeader(header, sink_rate, sink_channels, frames_written);
+		fseek(file, 0, SEEK_SET);
+		fwrite(&header, sizeof(header), 1, file);
+		fclose(file);
+		file = NULL;
+	}
+}
@@ -0,0 +1,51 @@
+#ifndef AUDIOSINK_H
+#define AUDIOSINK_H
+
+#include <cstdio>
+#include <string>
+
+struct ao_device;
+
+#define SINK_AO 0
+#define SINK_NULL 1
+#define SINK_WAV 2
+
+/* Where mixed blocks of interleaved 16-bit samples end up.
+ *   ao            the default libao device, which blocks to pace playback
+ *   null          discarded at the pace of a device
+ *   null:fast     discarded as fast as they are mixed
+ *   wav:FILE      written to a WAV file at the pace of a device
+ *   wav:fast:FILE written to a WAV file as fast as they are mixed
+ * For the paced sinks other than ao the caller does the waiting. */
+class AudioSink {
+	public:
+		AudioSink();
+		~AudioSink() { close(); }
+
+		/* Parse one of the specs above. Returns 0 on a bad spec. */
+		int configure(const char *spec);
+		int mode() const { return sink_mode; }
+		/* Whether write() itself waits for the device */
+		int blocking() const { return sink_mode == SINK_AO; }
+		/* Whether blocks should be produced without waiting for real time */
+		int fast() const { return unthrottled; }
+
+		/* Returns 0 if the device or file could not be opened */
+		int open(int rate, int channels);
+		void write(const short *frames, int count);
+		/* Finishes the WAV header */
+		void close();
+
+		unsigned long long framesWritten() const { return frames_written; }
+
+	private:
+		int sink_mode;
+		int unthrottled;
+		std::string path;
+		int sink_rate, sink_channels;
+		ao_device *device;
+		FILE *file;
+		unsigned long long frames_written;
+};
+
+#endif
@@ -0,0 +1,78 @@
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <cstring>
+
+#include "course.h"
+#include "pack.h"
+#include "trace.h"
+
+using namespace std;
+
+void Course::clear()
+{
+	memset(gamemat, 0, sizeof(gamemat));
+	memset(imindex, -1, sizeof(imindex));
+	holes.clear();
+	blocks.clear();
+	imblocks.clear();
+	treasure.clear();
+	impos.clear();
+}
+
+int loadCourse(Course &course, const char *filename)
+{
+	TRACE_SCOPE("loadCourse", filename);
+	// From the asset pack if there is one, else the loose file
+	AssetSpan span;
+	ifstream file;
+	istringstream packed;
+	istream *levelfile = &file;
+	if(findAsset(filename, span)){
+		packed.str(string((const char*)span.data, span.size));
+		levelfile = &packed;
+	}
+	else{
+		file.open(filename);
+		if(!file.is_open())
+			return 0;
+	}
+
+	course.clear();
+	string line;
+	int i=0;
+	while(i < COURSE_CELLS && getline(*levelfile, line)){
+		for(int j=0;j<COURSE_CELLS && line[j]!='\0';j++)
+			course.gamemat[i][j]=line[j];
+		i++;
+	}
+
+	for(int i= 0;i<course.nhor;i++)
+		for(int j=0;j<course.nvert;j++){
+			switch(course.gamemat[i][j]){
+				case 'X':
+					course.holes.push_back(make_pair(i,j));
+					break;
+				case 'B':
+					course.blocks.push_back(make_pair(i,j));
+					break;
+				case 'T':
+					course.treasure.push_back(make_pair(i,j));
+			}
+			if(course.gamemat[i][j]>='0' && course.gamemat[i][j]<='9')
+				course.imindex[i][j] = course.imblocks.size(),
+				course.imblocks.push_back(make_pair(i,j)), course.impos.push_back(make_pair((course.gamemat[i][j] - '0') * 20,1));
+		}
+	return 1;
+}
+
+void advanceCourse(Course &course)
+{
+	for(int p=0;p<course.impos.size();p++){
+		if(course.impos[p].first >= BLOCK_TOP_LIMIT)
+			course.impos[p].second = -1;
+		if(course.impos[p].first <= -BLOCK_TOP_LIMIT)
+			course.impos[p].second = 1;
+		course.impos[p].first += course.impos[p].second;
+	}
+}
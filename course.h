@@ -0,0 +1,42 @@
+#ifndef COURSE_H
+#define COURSE_H
+
+#include <vector>
+#include <utility>
+#include <cmath>
+
+#define COURSE_CELLS 11
+#define BLOCK_TOP_LIMIT 120
+
+/* Static spatial data of one level.
+ * Loaded once per level and shared read-only by every agent update;
+ * only the oscillating block heights in impos move, and they are
+ * advanced once per frame outside the parallel agent update. */
+struct Course {
+	char gamemat[COURSE_CELLS][COURSE_CELLS];
+	float edge, nvert, nhor;
+	std::vector<std::pair<int,int> > holes, blocks, imblocks, treasure;
+	std::vector<std::pair<int,int> > impos; // (height, direction) for each entry of imblocks
+	int imindex[COURSE_CELLS][COURSE_CELLS]; // index into imblocks for each cell, -1 if none
+
+	Course() : edge(20), nvert(10), nhor(10) {
+		clear();
+	}
+	void clear();
+
+	/* World space centre of grid cell (i,j) */
+	float cellX(int j) const { return edge*(-nhor/2) + j*edge + edge/2; }
+	float cellZ(int i) const { return edge*(-nvert/2) + i*edge + edge/2; }
+	/* Grid cell containing world position x (column) or z (row); may be outside the grid */
+	int cellJ(float x) const { return (int)floorf((x - edge*(-nhor/2)) / edge); }
+	int cellI(float z) const { return (int)floorf((z - edge*(-nvert/2)) / edge); }
+};
+
+/* Parse a level file ('.' floor, 'X' hole, 'B' rotating block, 'T' treasure,
+   '0'-'9' oscillating block with initial height). Returns 0 if the file could not be opened. */
+int loadCourse(Course &course, const char *filename);
+
+/* Move every oscillating block one step between +-BLOCK_TOP_LIMIT */
+void advanceCourse(Course &course);
+
+#endif
@@ -0,0 +1,40 @@
+#include <algorithm>
+#include <cstring>
+
+#include "drawlist.h"
+
+using namespace std;
+
+void DrawList::add(VAO *vao, const glm::mat4 &MVP, const glm::vec3 &position, float depth)
+{
+	DrawItem item;
+	item.vao = vao;
+	item.MVP = MVP;
+	item.position = position;
+	item.depth = depth;
+	item.order = items.size();
+	items.push_back(item);
+}
+
+static bool nearer(const DrawItem &a, const DrawItem &b)
+{
+	if(a.depth != b.depth)
+		return a.depth < b.depth;
+	return a.order < b.order;
+}
+
+void DrawList::sortFrontToBack()
+{
+	sort(items.begin(), items.end(), nearer);
+}
+
+int parseDrawOrder(const char *spec)
+{
+	if(!strcmp(spec, "code"))
+		return DRAW_CODE;
+	if(!strcmp(spec, "sorted"))
+		return DRAW_SORTED;
+	if(!strcmp(spec, "prepass"))
+		return DRAW_PREPASS;
+	return -1;
+}
@@ -0,0 +1,47 @@
+#ifndef DRAWLIST_H
+#define DRAWLIST_H
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+class VAO;
+
+/* ADVENTURA_DRAW_ORDER */
+#define DRAW_CODE 0     // opaque draws in the order the scene submits them
+#define DRAW_SORTED 1   // opaque draws front to back
+#define DRAW_PREPASS 2  // front to back after a depth only pass
+
+/* Depth that sorts behind everything, for the sky around the course */
+#define DRAW_FARTHEST 1e30f
+
+/* One textured draw, queued with the state it needs */
+struct DrawItem {
+	VAO *vao;
+	glm::mat4 MVP;
+	glm::vec3 position; // objectPosition, what the lighting measures from
+	float depth;        // distance along the view of the model's origin
+	int order;          // submission order, keeps equal depths stable
+};
+
+/* Textured draws of one frame, queued instead of issued on the spot so the
+ * opaque ones can be reordered. Keeps its memory from frame to frame. */
+class DrawList {
+	public:
+		void clear() { items.clear(); }
+		/* depth defaults to the clip w of the model's origin, its distance along the view */
+		void add(VAO *vao, const glm::mat4 &MVP, const glm::vec3 &position) { add(vao, MVP, position, MVP[3][3]); }
+		void add(VAO *vao, const glm::mat4 &MVP, const glm::vec3 &position, float depth);
+		void sortFrontToBack();
+
+		int size() const { return items.size(); }
+		const DrawItem &operator[](int i) const { return items[i]; }
+
+	private:
+		std::vector<DrawItem> items;
+};
+
+/* Parse "code", "sorted" or "prepass". Returns -1 on a bad spec. */
+int parseDrawOrder(const char *spec);
+
+#endif
@@ -0,0 +1,220 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "emitters.h"
+#include "mixer.h"
+
+using namespace std;
+
+/* Set in middle when the game thread swapped in a snapshot the audio thread has not seen */
+#define EMITTER_FRESH 4
+/* Combined gain below which an emitter is not mixed */
+#define EMITTER_SILENT 1e-4f
+
+EmitterField::EmitterField() : columns(1), rows(1), x0(0), z0(0), cell(1), radius(1), back(0), middle(1), published(0),
+	front(2), clock(0)
+{
+	memset(&listener, 0, sizeof(listener));
+	for(int s=0;s<3;s++){
+		Snapshot *snapshot = new Snapshot();
+		snapshot->count = 0;
+		snapshot->x = new float[EMITTER_MAX];
+		snapshot->y = new float[EMITTER_MAX];
+		snapshot->z = new float[EMITTER_MAX];
+		snapshot->gain = new float[EMITTER_MAX];
+		snapshot->sound = new int[EMITTER_MAX];
+		snapshot->offset = new int[EMITTER_MAX];
+		snapshots[s] = snapshot;
+	}
+	// Room for every emitter, so gathering never allocates on the audio thread
+	left = new float[EMITTER_MAX];
+	right = new float[EMITTER_MAX];
+}
+
+EmitterField::~EmitterField()
+{
+	for(int s=0;s<3;s++){
+		Snapshot *snapshot = snapshots[s];
+		delete[] snapshot->x;
+		delete[] snapshot->y;
+		delete[] snapshot->z;
+		delete[] snapshot->gain;
+		delete[] snapshot->sound;
+		delete[] snapshot->offset;
+		delete snapshot;
+	}
+	delete[] left;
+	delete[] right;
+}
+
+void EmitterField::setGrid(float gx0, float gz0, float size, int gcolumns, int grows)
+{
+	x0 = gx0;
+	z0 = gz0;
+	cell = size;
+	columns = max(1, gcolumns);
+	rows = max(1, min(grows, EMITTER_MAX_CELLS / columns));
+}
+
+void EmitterField::clear()
+{
+	ex.clear();
+	ey.clear();
+	ez.clear();
+	egain.clear();
+	esound.clear();
+}
+
+int EmitterField::add(int sound, float gain, float x, float y, float z)
+{
+	if(ex.size() == EMITTER_MAX)
+		return -1;
+	ex.push_back(x);
+	ey.push_back(y);
+	ez.push_back(z);
+	egain.push_back(gain);
+	esound.push_back(sound);
+	return ex.size() - 1;
+}
+
+void EmitterField::move(int id, float x, float y, float z)
+{
+	if(id < 0 || id >= ex.size())
+		return;
+	ex[id] = x;
+	ey[id] = y;
+	ez[id] = z;
+}
+
+void EmitterField::setGain(int id, float gain)
+{
+	if(id >= 0 && id < egain.size())
+		egain[id] = gain;
+}
+
+/* Cell index of a position, clamped onto the grid */
+int EmitterField::cellOf(float x, float z, int &i, int &j) const
+{
+	j = max(0, min(columns - 1, (int)floorf((x - x0) / cell)));
+	i = max(0, min(rows - 1, (int)floorf((z - z0) / cell)));
+	return i * columns + j;
+}
+
+void EmitterField::publish()
+{
+	Snapshot &s = *snapshots[back];
+	int n = ex.size(), cells = columns * rows, i, j;
+	s.count = n;
+	s.columns = columns;
+	s.rows = rows;
+	s.x0 = x0;
+	s.z0 = z0;
+	s.cell = cell;
+	s.radius = radius;
+	s.listener = listener;
+
+	// Counting sort by cell
+	memset(s.start, 0, (cells + 1) * sizeof(int));
+	for(int e=0;e<n;e++)
+		s.start[cellOf(ex[e], ez[e], i, j) + 1]++;
+	for(int c=0;c<cells;c++)
+		s.start[c + 1] += s.start[c];
+	int fill[EMITTER_MAX_CELLS];
+	memcpy(fill, s.start, cells * sizeof(int));
+	for(int e=0;e<n;e++){
+		int at = fill[cellOf(ex[e], ez[e], i, j)]++;
+		s.x[at] = ex[e];
+		s.y[at] = ey[e];
+		s.z[at] = ez[e];
+		s.gain[at] = egain[e];
+		s.sound[at] = esound[e];
+		// Spread emitters of the same sound over its loop so they do not play in unison
+		s.offset[at] = e * 7919;
+	}
+
+	back = middle.exchange(back | EMITTER_FRESH) & ~EMITTER_FRESH;
+	published = n;
+}
+
+int EmitterField::mix(const Mixer &mixer, float *out, int frames)
+{
+	if(middle.load(memory_order_relaxed) & EMITTER_FRESH)
+		front = middle.exchange(front) & ~EMITTER_FRESH;
+	const Snapshot &s = *snapshots[front];
+	long long now = clock;
+	clock += frames;
+	if(!s.count)
+		return 0;
+
+	// Only cells within the radius of the listener's cell: one contiguous run per row
+	int li = max(0, min(s.rows - 1, (int)floorf((s.listener.z - s.z0) / s.cell)));
+	int lj = max(0, min(s.columns - 1, (int)floorf((s.listener.x - s.x0) / s.cell)));
+	int reach = (int)ceilf(s.radius / s.cell);
+	int mixed = 0;
+	for(int i=max(0, li - reach); i<=min(s.rows - 1, li + reach); i++){
+		int begin = s.start[i * s.columns + max(0, lj - reach)];
+		int end = s.start[i * s.columns + min(s.columns - 1, lj + reach) + 1];
+		if(begin == end)
+			continue;
+		emitterGains(s.x + begin, s.y + begin, s.z + begin, s.gain + begin, end - begin, s.listener, s.radius,
+				left + begin, right + begin);
+		for(int e=begin;e<end;e++){
+			if(left[e] + right[e] < EMITTER_SILENT)
+				continue;
+			const vector<float> &sound = mixer.sound(s.sound[e]);
+			if(sound.empty())
+				continue;
+			// Loop the sound across the block
+			long long length = sound.size();
+			int pos = (now + s.offset[e]) % length, done = 0;
+			while(done < frames){
+				int count = min((long long)(frames - done), length - pos);
+				mixMono(out + done * 2, &sound[pos], count, left[e], right[e]);
+				done += count;
+				pos = 0;
+			}
+			mixed++;
+		}
+	}
+	return mixed;
+}
+
+void emitterGains(const float *x, const float *y, const float *z, const float *gain, int count,
+		const Listener &listener, float radius, float *left, float *right)
+{
+	// Right of the heading, as moveAgent steps sideways
+	float rx = cosf(listener.angle * M_PI / 180.0f), rz = sinf(listener.angle * M_PI / 180.0f);
+	float inverse = 1 / radius;
+	int e = 0;
+#ifdef __SSE2__
+	__m128 lx = _mm_set1_ps(listener.x), ly = _mm_set1_ps(listener.y), lz = _mm_set1_ps(listener.z);
+	__m128 vrx = _mm_set1_ps(rx), vrz = _mm_set1_ps(rz), vinverse = _mm_set1_ps(inverse);
+	__m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1), half = _mm_set1_ps(0.5f), tiny = _mm_set1_ps(1e-6f);
+	for(; e + 4 <= count; e += 4){
+		__m128 dx = _mm_sub_ps(_mm_loadu_ps(x + e), lx);
+		__m128 dy = _mm_sub_ps(_mm_loadu_ps(y + e), ly);
+		__m128 dz = _mm_sub_ps(_mm_loadu_ps(z + e), lz);
+		__m128 distance = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+		// (1 - d/r)^2, zero beyond the radius
+		__m128 falloff = _mm_max_ps(zero, _mm_sub_ps(one, _mm_mul_ps(distance, vinverse)));
+		__m128 g = _mm_mul_ps(_mm_loadu_ps(gain + e), _mm_mul_ps(falloff, falloff));
+		__m128 pan = _mm_div_ps(_mm_add_ps(_mm_mul_ps(dx, vrx), _mm_mul_ps(dz, vrz)), _mm_max_ps(distance, tiny));
+		pan = _mm_mul_ps(half, pan);
+		_mm_storeu_ps(left + e, _mm_mul_ps(g, _mm_sqrt_ps(_mm_max_ps(zero, _mm_sub_ps(half, pan)))));
+		_mm_storeu_ps(right + e, _mm_mul_ps(g, _mm_sqrt_ps(_mm_max_ps(zero, _mm_add_ps(half, pan)))));
+	}
+#endif
+	for(; e < count; e++){
+		float dx = x[e] - listener.x, dy = y[e] - listener.y, dz = z[e] - listener.z;
+		float distance = sqrtf(dx*dx + dy*dy + dz*dz);
+		float falloff = max(0.0f, 1 - distance * inverse);
+		float g = gain[e] * falloff * falloff;
+		float pan = 0.5f * (dx * rx + dz * rz) / max(distance, 1e-6f);
+		left[e] = g * sqrtf(max(0.0f, 0.5f - pan));
+		right[e] = g * sqrtf(max(0.0f, 0.5f + pan));
+	}
+}
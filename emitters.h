@@ -0,0 +1,90 @@
+#ifndef EMITTERS_H
+#define EMITTERS_H
+
+#include <atomic>
+#include <vector>
+
+class Mixer;
+
+#define EMITTER_MAX 1024
+#define EMITTER_MAX_CELLS 4096
+
+/* Where positional sound is heard from: a position and a heading in
+   degrees, as Agent has them */
+struct Listener {
+	float x, y, z, angle;
+};
+
+/* Looping sounds at points in the world.
+ * The game thread edits emitters and the listener and publish()es them once
+ * a frame into a triple buffer, sorted by grid cell. Each audio block the
+ * audio thread takes the latest snapshot, gathers the cells within the
+ * audible radius of the listener, computes the gain and pan of every
+ * emitter in them in one SSE pass and mixes the ones that can be heard.
+ * Emitters keep no playback state: each plays its sound at the block clock
+ * plus an offset, so one that is culled and comes back does not restart. */
+class EmitterField {
+	public:
+		EmitterField();
+		~EmitterField();
+
+		/* Game thread. columns x rows cells of size cell from (x0, z0) */
+		void setGrid(float x0, float z0, float cell, int columns, int rows);
+		/* Distance at which emitters fall silent */
+		void setRadius(float distance) { radius = distance; }
+		void clear();
+		/* Returns the emitter's id, -1 if there are EMITTER_MAX already */
+		int add(int sound, float gain, float x, float y, float z);
+		void move(int id, float x, float y, float z);
+		void setGain(int id, float gain);
+		void setListener(const Listener &pose) { listener = pose; }
+		/* Hand everything above to the audio thread */
+		void publish();
+
+		/* Audio thread: add the audible emitters into frames of interleaved
+		   stereo. Returns how many were mixed. */
+		int mix(const Mixer &mixer, float *out, int frames);
+		/* Whether the last published snapshot had any emitters */
+		int active() const { return published > 0; }
+
+	private:
+		struct Snapshot {
+			int count, columns, rows;
+			float x0, z0, cell, radius;
+			Listener listener;
+			// Emitters sorted by cell, cell c holding [start[c], start[c+1])
+			float *x, *y, *z, *gain;
+			int *sound, *offset;
+			int start[EMITTER_MAX_CELLS + 1];
+		};
+
+		EmitterField(const EmitterField&);
+		EmitterField &operator=(const EmitterField&);
+
+		int cellOf(float x, float z, int &i, int &j) const;
+
+		// Game thread
+		std::vector<float> ex, ey, ez, egain;
+		std::vector<int> esound;
+		int columns, rows;
+		float x0, z0, cell, radius;
+		Listener listener;
+		int back;
+
+		// Shared: index of the snapshot in the middle, EMITTER_FRESH if newer than front
+		std::atomic<int> middle;
+		std::atomic<int> published;
+		Snapshot *snapshots[3];
+
+		// Audio thread
+		int front;
+		long long clock;
+		float *left, *right;
+};
+
+/* The gain of each emitter over distance and its constant power pan
+   relative to the listener's right, vectorised with SSE where available */
+void emitterGains(const float *x, const float *y, const float *z, const float *gain, int count,
+		const Listener &listener, float radius, float *left, float *right);
+
+#endif
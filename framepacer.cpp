@@ -0,0 +1,195 @@
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <thread>
+
+#include "framepacer.h"
+
+using namespace std;
+
+#define FRAMEPACER_WINDOW 1024
+// Sleep until this close to a deadline, then spin the rest of the way
+#define SPIN_MARGIN_USEC 2000
+// Frames between two adaptive target decisions
+#define ADAPT_INTERVAL 120
+#define ADAPT_MAX_DIVISOR 4
+
+void FrameHistogram::reset()
+{
+	memset(buckets, 0, sizeof(buckets));
+	total = sum = max_usec = 0;
+}
+
+int FrameHistogram::bucketOf(long long usec)
+{
+	if(usec < 0)
+		usec = 0;
+	if(usec < FRAMEHIST_SUB)
+		return usec;
+	int e = 63 - __builtin_clzll(usec);
+	int shift = e - FRAMEHIST_SUB_BITS;
+	int bucket = (shift + 1) * FRAMEHIST_SUB + (int)((usec >> shift) - FRAMEHIST_SUB);
+	return bucket < FRAMEHIST_BUCKETS ? bucket : FRAMEHIST_BUCKETS - 1;
+}
+
+long long FrameHistogram::bucketValue(int bucket)
+{
+	if(bucket < FRAMEHIST_SUB)
+		return bucket;
+	int shift = bucket / FRAMEHIST_SUB - 1;
+	long long sub = bucket % FRAMEHIST_SUB;
+	// Report the top of the bucket so percentiles never under-state
+	return ((FRAMEHIST_SUB + sub) << shift) + ((1LL << shift) - 1);
+}
+
+void FrameHistogram::add(long long usec)
+{
+	buckets[bucketOf(usec)]++;
+	total++;
+	sum += usec;
+	if(usec > max_usec)
+		max_usec = usec;
+}
+
+void FrameHistogram::remove(long long usec)
+{
+	buckets[bucketOf(usec)]--;
+	total--;
+	sum -= usec;
+	// The maximum is only known to a bucket once samples leave the window
+	if(usec >= max_usec){
+		max_usec = 0;
+		for(int b=FRAMEHIST_BUCKETS-1;b>=0;b--)
+			if(buckets[b]){
+				max_usec = bucketValue(b);
+				break;
+			}
+	}
+}
+
+long long FrameHistogram::percentile(double q) const
+{
+	if(!total)
+		return 0;
+	long long rank = (long long)(q * total + 0.5);
+	if(rank < 1)
+		rank = 1;
+	long long seen = 0;
+	for(int b=0;b<FRAMEHIST_BUCKETS;b++){
+		seen += buckets[b];
+		if(seen >= rank)
+			return min(bucketValue(b), max_usec);
+	}
+	return max_usec;
+}
+
+FramePacer::FramePacer() : pace_mode(PACE_VSYNC), target_hz(60), divisor(1), last_usec(0),
+	ring_pos(0), ring_count(0), frames_since_adapt(0)
+{
+	ring.resize(FRAMEPACER_WINDOW);
+	last = deadline = Clock::now();
+}
+
+int FramePacer::configure(const char *spec)
+{
+	if(!spec || !*spec)
+		return 0;
+	double hz = 60;
+	const char *colon = strchr(spec, ':');
+	if(colon){
+		hz = atof(colon + 1);
+		if(hz <= 0)
+			return 0;
+	}
+	size_t len = colon ? colon - spec : strlen(spec);
+	if(!strncmp(spec, "vsync", len) && len == 5)
+		pace_mode = PACE_VSYNC;
+	else if(!strncmp(spec, "uncapped", len) && len == 8)
+		pace_mode = PACE_UNCAPPED;
+	else if(!strncmp(spec, "cap", len) && len == 3)
+		pace_mode = PACE_CAP;
+	else if(!strncmp(spec, "adaptive", len) && len == 8)
+		pace_mode = PACE_ADAPTIVE;
+	else
+		return 0;
+	target_hz = hz;
+	divisor = 1;
+	last = deadline = Clock::now();
+	return 1;
+}
+
+void FramePacer::waitUntil(Clock::time_point until)
+{
+	Clock::time_point now = Clock::now();
+	if(until - now > chrono::microseconds(SPIN_MARGIN_USEC))
+		this_thread::sleep_for(until - now - chrono::microseconds(SPIN_MARGIN_USEC));
+	while(Clock::now() < until)
+		this_thread::yield();
+}
+
+void FramePacer::adapt()
+{
+	if(++frames_since_adapt < ADAPT_INTERVAL)
+		return;
+	frames_since_adapt = 0;
+	long long period = (long long)(1e6 / targetHz());
+	long long p99 = work.percentile(0.99);
+	if(p99 > period * 1.05 && divisor < ADAPT_MAX_DIVISOR)
+		divisor++;
+	// Only step back up when the faster period would still have been met
+	else if(divisor > 1 && p99 < 1e6 / (target_hz / (divisor - 1)) * 0.8)
+		divisor--;
+	work.reset();
+}
+
+void FramePacer::endFrame()
+{
+	long long work_usec = chrono::duration_cast<chrono::microseconds>(Clock::now() - last).count();
+	if(pace_mode == PACE_CAP || pace_mode == PACE_ADAPTIVE){
+		Clock::duration period = chrono::duration_cast<Clock::duration>(chrono::duration<double>(1.0 / targetHz()));
+		deadline += period;
+		Clock::time_point now = Clock::now();
+		// Fell more than a frame behind: start a new schedule instead of bursting to catch up
+		if(deadline + period < now)
+			deadline = now;
+		waitUntil(deadline);
+	}
+
+	Clock::time_point now = Clock::now();
+	last_usec = chrono::duration_cast<chrono::microseconds>(now - last).count();
+	last = now;
+
+	all.add(last_usec);
+	if(ring_count == FRAMEPACER_WINDOW)
+		window.remove(ring[ring_pos]);
+	else
+		ring_count++;
+	ring[ring_pos] = last_usec;
+	window.add(last_usec);
+	work.add(work_usec);
+	ring_pos = (ring_pos + 1) % FRAMEPACER_WINDOW;
+
+	if(pace_mode == PACE_ADAPTIVE)
+		adapt();
+}
+
+void FramePacer::dump(FILE *out) const
+{
+	static const char *names[] = { "vsync", "uncapped", "cap", "adaptive" };
+	fprintf(out, "frame pacing: %s", names[pace_mode]);
+	if(pace_mode == PACE_CAP || pace_mode == PACE_ADAPTIVE)
+		fprintf(out, " %.1f Hz (now %.1f Hz)", target_hz, targetHz());
+	fprintf(out, "\n");
+	const FrameHistogram *h[] = { &all, &window };
+	const char *label[] = { "run", "last frames" };
+	for(int i=0;i<2;i++)
+		fprintf(out, "%-12s frames %lld  mean %.2f ms  p50 %.2f ms  p99 %.2f ms  max %.2f ms\n",
+				label[i], h[i]->count(), h[i]->mean() / 1000.0,
+				h[i]->percentile(0.5) / 1000.0, h[i]->percentile(0.99) / 1000.0, h[i]->maximum() / 1000.0);
+
+	// Full lifetime distribution so runs can be compared offline
+	fprintf(out, "# bucket_upper_ms frames\n");
+	for(int b=0;b<FRAMEHIST_BUCKETS;b++)
+		if(all.bucketCount(b))
+			fprintf(out, "%.3f %lld\n", FrameHistogram::bucketValue(b) / 1000.0, all.bucketCount(b));
+}
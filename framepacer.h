@@ -0,0 +1,90 @@
+#ifndef FRAMEPACER_H
+#define FRAMEPACER_H
+
+#include <cstdio>
+#include <chrono>
+#include <vector>
+
+#define PACE_VSYNC 0
+#define PACE_UNCAPPED 1
+#define PACE_CAP 2
+#define PACE_ADAPTIVE 3
+
+/* Log-linear histogram of durations in microseconds (HDR histogram style):
+ * every power of two is split into FRAMEHIST_SUB buckets, so recorded
+ * values keep about 3% relative precision from 1us up to ~1 hour. */
+#define FRAMEHIST_SUB_BITS 5
+#define FRAMEHIST_SUB (1 << FRAMEHIST_SUB_BITS)
+#define FRAMEHIST_BUCKETS (32 * FRAMEHIST_SUB)
+
+class FrameHistogram {
+	public:
+		FrameHistogram() { reset(); }
+		void reset();
+		void add(long long usec);
+		void remove(long long usec);
+		long long count() const { return total; }
+		long long bucketCount(int bucket) const { return buckets[bucket]; }
+		/* Smallest recorded value v such that q of all samples are <= v */
+		long long percentile(double q) const;
+		long long maximum() const { return max_usec; }
+		double mean() const { return total ? (double)sum / total : 0; }
+
+		static int bucketOf(long long usec);
+		static long long bucketValue(int bucket);
+
+	private:
+		long long buckets[FRAMEHIST_BUCKETS];
+		long long total, sum, max_usec;
+};
+
+/* Paces the main loop after every buffer swap and records frame times.
+ *   vsync      swap interval 1, the driver blocks
+ *   uncapped   swap interval 0, no waiting
+ *   cap:N      swap interval 0, sleep then spin up to each 1/N s deadline
+ *   adaptive:N like cap, but the target falls to N/2, N/3.. while frames
+ *              keep missing it and climbs back once they fit comfortably */
+class FramePacer {
+	public:
+		FramePacer();
+
+		/* Parse "vsync", "uncapped", "cap:60" or "adaptive:60". Returns 0 on a bad spec. */
+		int configure(const char *spec);
+		int mode() const { return pace_mode; }
+		int swapInterval() const { return pace_mode == PACE_VSYNC ? 1 : 0; }
+
+		/* Call right after the buffer swap */
+		void endFrame();
+
+		/* Duration of the last frame in seconds */
+		double frameSeconds() const { return last_usec / 1e6; }
+		double targetHz() const { return target_hz / divisor; }
+
+		/* Last FRAMEPACER_WINDOW frames and the whole run */
+		const FrameHistogram &recent() const { return window; }
+		const FrameHistogram &lifetime() const { return all; }
+
+		void dump(FILE *out) const;
+
+	private:
+		typedef std::chrono::steady_clock Clock;
+
+		void waitUntil(Clock::time_point deadline);
+		void adapt();
+
+		int pace_mode;
+		double target_hz;
+		int divisor;
+		Clock::time_point last, deadline;
+		long long last_usec;
+		FrameHistogram window, all;
+		/* Time the frames since the last adapt() decision took before
+		   waiting for their deadline; paced times never fall below the
+		   current period, so they cannot tell when a faster one fits */
+		FrameHistogram work;
+		std::vector<long long> ring;
+		int ring_pos, ring_count;
+		int frames_since_adapt;
+};
+
+#endif
@@ -0,0 +1,95 @@
+#include <algorithm>
+#include <cstdio>
+
+#include "game.h"
+
+using namespace std;
+
+GameInstance::GameInstance() : level(1), open_portal(0), portal_pos(PORTAL_START), portal_trigger(-1), events(0), ticks(0)
+{
+}
+
+static void openPortal(GameInstance &game)
+{
+	Course &course = game.course;
+	float edge = course.edge, nhor = course.nhor, nvert = course.nvert;
+	// Portal sits on the top right cell and rises out of the floor
+	float xpos = edge * (nhor/2) - edge/2;
+	float zpos = edge *(-nvert/2) + edge/2;
+	game.open_portal = 1;
+	game.events |= GAME_PORTAL_OPEN;
+	game.portal_trigger = game.triggers.add(course, TRIGGER_PORTAL, 0, xpos - edge/2, xpos + edge/2,
+			game.portal_pos - edge/2, game.portal_pos + edge/2, zpos - edge/2, zpos + edge/2);
+}
+
+/* Trigger handlers, called from triggers.dispatch() */
+static void onTreasure(void *context, const TriggerEvent &event)
+{
+	GameInstance &game = *(GameInstance*)context;
+	pair<int,int> cell = game.course.treasure[event.id];
+	game.triggers.remove(event.trigger);
+	vector<pair<int,int> >::iterator it = find(game.treasure.begin(), game.treasure.end(), cell);
+	*it = game.treasure.back();
+	game.treasure.pop_back();
+	game.events |= GAME_TREASURE;
+	if(!game.treasure.size())
+		openPortal(game);
+}
+
+static void onPortal(void *context, const TriggerEvent &event)
+{
+	GameInstance &game = *(GameInstance*)context;
+	game.events |= GAME_PORTAL_ENTERED;
+}
+
+void startCourse(GameInstance &game, const Course &course)
+{
+	if(&game.course != &course)
+		game.course = course;
+	resetAgent(game.course, game.player);
+	game.treasure = game.course.treasure;
+	game.open_portal = 0;
+	game.portal_pos = PORTAL_START;
+	game.portal_trigger = -1;
+	game.events = 0;
+	game.ticks = 0;
+
+	game.triggers.clear();
+	game.triggers.setHandler(TRIGGER_TREASURE, onTreasure, &game);
+	game.triggers.setHandler(TRIGGER_PORTAL, onPortal, &game);
+	float edge = game.course.edge;
+	for(int p=0;p<game.course.treasure.size();p++){
+		float xpos = game.course.cellX(game.course.treasure[p].second);
+		float ypos = 5;
+		float zpos = game.course.cellZ(game.course.treasure[p].first);
+		game.triggers.add(game.course, TRIGGER_TREASURE, p, xpos - edge/2, xpos + edge/2, ypos - edge/2, ypos + edge/2, zpos - edge/2, zpos + edge/2);
+	}
+	if(!game.course.treasure.size())
+		openPortal(game);
+}
+
+int startLevel(GameInstance &game, int level)
+{
+	char filename[100];
+	sprintf(filename,"%d.txt",level);
+	game.level = level;
+	int found = loadCourse(game.course, filename);
+	startCourse(game, game.course);
+	return found;
+}
+
+void stepGame(GameInstance &game)
+{
+	game.events = 0;
+	moveAgent(game.course, game.player);
+	if(game.open_portal){
+		game.portal_pos += 0.2;
+		game.portal_pos = min(game.portal_pos,PORTAL_TOP);
+		float edge = game.course.edge;
+		game.triggers.setHeight(game.portal_trigger, game.portal_pos - edge/2, game.portal_pos + edge/2);
+	}
+	game.triggers.update(game.course, game.player);
+	game.triggers.dispatch();
+	advanceCourse(game.course);
+	game.ticks++;
+}
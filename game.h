@@ -0,0 +1,45 @@
+#ifndef GAME_H
+#define GAME_H
+
+#include <vector>
+#include <utility>
+
+#include "course.h"
+#include "agent.h"
+#include "trigger.h"
+
+/* Bits of GameInstance::events, set by the tick that caused them */
+#define GAME_TREASURE 1
+#define GAME_PORTAL_OPEN 2
+#define GAME_PORTAL_ENTERED 4
+
+#define PORTAL_START -10
+#define PORTAL_TOP 10.0f
+
+/* All simulation state of one running game.
+ * Nothing in here touches GL, so any number of instances can be stepped
+ * side by side, e.g. by the headless BatchRunner. */
+struct GameInstance {
+	Course course;
+	Agent player;
+	std::vector<std::pair<int,int> > treasure; // treasure still on the course
+	TriggerSystem triggers;
+	int level;
+	int open_portal;
+	float portal_pos;
+	int portal_trigger;
+	int events;
+	long ticks;
+
+	GameInstance();
+};
+
+/* Load "<level>.txt" and put the player on the start cell. Returns 0 if the file is missing. */
+int startLevel(GameInstance &game, int level);
+/* Start playing an already loaded course */
+void startCourse(GameInstance &game, const Course &course);
+
+/* Advance one tick using the input flags set on game.player */
+void stepGame(GameInstance &game);
+
+#endif
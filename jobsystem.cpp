@@ -0,0 +1,179 @@
+#include <cstdio>
+
+#include "jobsystem.h"
+#include "trace.h"
+
+/* Index of the deque owned by the current thread, -1 for non workers */
+static thread_local int currentQueue = -1;
+static thread_local JobSystem *currentSystem = NULL;
+
+JobSystem::JobSystem(int threads) : queued(0), submitted(0), stopping(false)
+{
+	if(threads <= 0)
+		threads = std::thread::hardware_concurrency();
+	if(threads <= 0)
+		threads = 1;
+	for(int i=0;i<threads-1;i++)
+		workers.push_back(new Worker());
+	for(int i=0;i<workers.size();i++)
+		workers[i]->thread = std::thread(&JobSystem::workerLoop, this, i);
+}
+
+JobSystem::~JobSystem()
+{
+	wait();
+	{
+		std::lock_guard<std::mutex> guard(sleepLock);
+		stopping = true;
+	}
+	wake.notify_all();
+	for(int i=0;i<workers.size();i++){
+		workers[i]->thread.join();
+		delete workers[i];
+	}
+}
+
+void JobSystem::push(int queue, const Job &job)
+{
+	Worker *w = queue < 0 ? &caller : workers[queue];
+	{
+		std::lock_guard<std::mutex> guard(w->lock);
+		w->jobs.push_back(job);
+		queued++;
+	}
+	// Taking the sleep lock orders this push against a worker about to wait
+	{
+		std::lock_guard<std::mutex> guard(sleepLock);
+	}
+	wake.notify_one();
+}
+
+bool JobSystem::pop(int queue, Job &job)
+{
+	Worker *w = queue < 0 ? &caller : workers[queue];
+	std::lock_guard<std::mutex> guard(w->lock);
+	if(w->jobs.empty())
+		return false;
+	job = w->jobs.back();
+	w->jobs.pop_back();
+	queued--;
+	return true;
+}
+
+bool JobSystem::steal(int thief, Job &job)
+{
+	int n = workers.size();
+	// Start with the shared deque, then walk the others starting next to the thief
+	for(int k=-1;k<n;k++){
+		int victim = k < 0 ? -1 : (thief + 1 + k) % n;
+		if(victim == thief && thief >= 0)
+			continue;
+		Worker *w = victim < 0 ? &caller : workers[victim];
+		std::lock_guard<std::mutex> guard(w->lock);
+		if(w->jobs.empty())
+			continue;
+		job = w->jobs.front();
+		w->jobs.pop_front();
+		queued--;
+		return true;
+	}
+	return false;
+}
+
+void JobSystem::run(int queue, Job &job)
+{
+	if(job.task){
+		job.task();
+		submitted--;
+		return;
+	}
+	// Keep splitting: hand the upper half to thieves, work on the lower half
+	while(job.end - job.begin > job.grain){
+		int mid = job.begin + (job.end - job.begin) / 2;
+		Job upper = job;
+		upper.begin = mid;
+		job.end = mid;
+		job.pending->fetch_add(1);
+		push(queue, upper);
+	}
+	(*job.fn)(job.begin, job.end);
+	job.pending->fetch_sub(1);
+}
+
+void JobSystem::workerLoop(int index)
+{
+	currentQueue = index;
+	currentSystem = this;
+	char name[32];
+	snprintf(name, sizeof(name), "worker %d", index + 1);
+	traceThreadName(name);
+	Job job;
+	while(1){
+		if(pop(index, job) || steal(index, job)){
+			run(index, job);
+			continue;
+		}
+		std::unique_lock<std::mutex> guard(sleepLock);
+		wake.wait(guard, [this]{ return stopping || queued > 0; });
+		if(stopping && queued == 0)
+			return;
+	}
+}
+
+void JobSystem::parallelFor(int count, int grain, const RangeFn &fn)
+{
+	if(count <= 0)
+		return;
+	if(grain < 1)
+		grain = 1;
+	if(workers.empty() || count <= grain){
+		fn(0, count);
+		return;
+	}
+
+	std::atomic<int> pending(1);
+	Job job;
+	job.fn = &fn;
+	job.begin = 0;
+	job.end = count;
+	job.grain = grain;
+	job.pending = &pending;
+
+	int queue = currentSystem == this ? currentQueue : -1;
+	run(queue, job);
+	// Help out until every range of this batch has finished
+	while(pending.load() > 0){
+		if(pop(queue, job) || steal(queue, job))
+			run(queue, job);
+		else
+			std::this_thread::yield();
+	}
+}
+
+void JobSystem::submit(const std::function<void()> &fn)
+{
+	Job job;
+	job.fn = NULL;
+	job.task = fn;
+	job.begin = job.end = job.grain = 0;
+	job.pending = NULL;
+	submitted++;
+	if(workers.empty()){
+		job.task();
+		submitted--;
+		return;
+	}
+	push(currentSystem == this ? currentQueue : -1, job);
+}
+
+void JobSystem::wait()
+{
+	int queue = currentSystem == this ? currentQueue : -1;
+	Job job;
+	while(submitted.load() > 0){
+		if(pop(queue, job) || steal(queue, job))
+			run(queue, job);
+		else
+			std::this_thread::yield();
+	}
+}
@@ -0,0 +1,63 @@
+#ifndef JOBSYSTEM_H
+#define JOBSYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Work-stealing job system.
+ * Every worker owns a deque: it pushes and pops ranges at the back, idle
+ * workers steal from the front, so the biggest untouched ranges migrate.
+ * The thread calling parallelFor() works on the batch as well. */
+class JobSystem {
+	public:
+		typedef std::function<void(int,int)> RangeFn;
+
+		/* threads == 0 uses every hardware thread (including the caller) */
+		explicit JobSystem(int threads = 0);
+		~JobSystem();
+
+		/* Run fn(begin, end) over [0, count) in ranges of at most grain items
+		   and return when all of them are done */
+		void parallelFor(int count, int grain, const RangeFn &fn);
+
+		/* Queue a single job and return immediately */
+		void submit(const std::function<void()> &fn);
+		/* Block until every submit()ed job has finished */
+		void wait();
+
+		int threadCount() const { return (int)workers.size() + 1; }
+
+	private:
+		struct Job {
+			const RangeFn *fn;
+			std::function<void()> task;
+			int begin, end, grain;
+			std::atomic<int> *pending;
+		};
+		struct Worker {
+			std::mutex lock;
+			std::deque<Job> jobs;
+			std::thread thread;
+		};
+
+		void push(int queue, const Job &job);
+		bool pop(int queue, Job &job);
+		bool steal(int thief, Job &job);
+		void run(int queue, Job &job);
+		void workerLoop(int index);
+
+		std::vector<Worker*> workers;
+		Worker caller; // deque used by threads that are not workers
+		std::mutex sleepLock;
+		std::condition_variable wake;
+		std::atomic<int> queued;
+		std::atomic<int> submitted;
+		std::atomic<bool> stopping;
+};
+
+#endif
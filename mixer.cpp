@@ -0,0 +1,135 @@
+#include <algorithm>
+#include <cmath>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "mixer.h"
+
+using namespace std;
+
+Mixer::Mixer() : active(0), head(0), tail(0), steal_count(0), drop_count(0)
+{
+}
+
+int Mixer::addSound(const vector<float> &samples)
+{
+	sounds.push_back(samples);
+	return sounds.size() - 1;
+}
+
+const vector<float> &Mixer::sound(int id) const
+{
+	return id >= 0 && id < sounds.size() ? sounds[id] : none;
+}
+
+int Mixer::play(int sound, float gain, float pan)
+{
+	unsigned h = head.load(memory_order_relaxed);
+	if(sound < 0 || sound >= sounds.size() || h - tail.load(memory_order_acquire) == MIXER_QUEUE){
+		drop_count++;
+		return 0;
+	}
+	Command &command = queue[h % MIXER_QUEUE];
+	command.sound = sound;
+	command.gain = gain;
+	command.pan = max(-1.0f, min(1.0f, pan));
+	head.store(h + 1, memory_order_release);
+	return 1;
+}
+
+void Mixer::start(const Command &command)
+{
+	int v = active;
+	if(active == MIXER_VOICES){
+		// Steal the voice with the least left to play
+		v = 0;
+		for(int i=1;i<active;i++)
+			if(voices[i].length - voices[i].pos < voices[v].length - voices[v].pos)
+				v = i;
+		steal_count++;
+	}
+	else
+		active++;
+	const vector<float> &sound = sounds[command.sound];
+	// Constant power pan
+	float angle = (command.pan + 1) * (float)M_PI / 4;
+	voices[v].samples = sound.empty() ? NULL : &sound[0];
+	voices[v].length = sound.size();
+	voices[v].pos = 0;
+	voices[v].left = command.gain * cosf(angle);
+	voices[v].right = command.gain * sinf(angle);
+}
+
+void Mixer::mix(float *out, int frames)
+{
+	unsigned t = tail.load(memory_order_relaxed), h = head.load(memory_order_acquire);
+	for(; t != h; t++)
+		start(queue[t % MIXER_QUEUE]);
+	tail.store(t, memory_order_release);
+
+	for(int v=0;v<active;){
+		Voice &voice = voices[v];
+		int count = min(frames, voice.length - voice.pos);
+		mixMono(out, voice.samples + voice.pos, count, voice.left, voice.right);
+		voice.pos += count;
+		// Finished voices swap with the last one, so the active ones stay packed
+		if(voice.pos == voice.length)
+			voice = voices[--active];
+		else
+			v++;
+	}
+}
+
+void mixMono(float *out, const float *in, int frames, float left, float right)
+{
+	int i = 0;
+#ifdef __SSE2__
+	__m128 gains = _mm_setr_ps(left, right, left, right);
+	for(; i + 4 <= frames; i += 4){
+		__m128 s = _mm_loadu_ps(in + i);
+		__m128 lo = _mm_unpacklo_ps(s, s); // s0 s0 s1 s1
+		__m128 hi = _mm_unpackhi_ps(s, s); // s2 s2 s3 s3
+		_mm_storeu_ps(out + 2*i, _mm_add_ps(_mm_loadu_ps(out + 2*i), _mm_mul_ps(lo, gains)));
+		_mm_storeu_ps(out + 2*i + 4, _mm_add_ps(_mm_loadu_ps(out + 2*i + 4), _mm_mul_ps(hi, gains)));
+	}
+#endif
+	for(; i < frames; i++){
+		out[2*i] += in[i] * left;
+		out[2*i + 1] += in[i] * right;
+	}
+}
+
+void pcmToFloat(float *out, const short *in, int samples)
+{
+	int i = 0;
+#ifdef __SSE2__
+	__m128 scale = _mm_set1_ps(1.0f / 32768);
+	for(; i + 8 <= samples; i += 8){
+		__m128i s = _mm_loadu_si128((const __m128i*)(in + i));
+		// Sign extend by putting each sample in the top half of a 32 bit lane
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16);
+		__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16);
+		_mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+		_mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+	}
+#endif
+	for(; i < samples; i++)
+		out[i] = in[i] * (1.0f / 32768);
+}
+
+void floatToPcm(short *out, const float *in, int samples)
+{
+	int i = 0;
+#ifdef __SSE2__
+	__m128 scale = _mm_set1_ps(32768);
+	for(; i + 8 <= samples; i += 8){
+		// Saturating pack to 16 bits does the clamping
+		__m128i lo = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(in + i), scale));
+		__m128i hi = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(in + i + 4), scale));
+		_mm_storeu_si128((__m128i*)(out + i), _mm_packs_epi32(lo, hi));
+	}
+#endif
+	for(; i < samples; i++)
+		out[i] = (short)max(-32768L, min(32767L, lrintf(in[i] * 32768)));
+}
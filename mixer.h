@@ -0,0 +1,71 @@
+#ifndef MIXER_H
+#define MIXER_H
+
+#include <atomic>
+#include <vector>
+
+/* Voices mixed at once; a sound started while all are busy takes over the
+   voice closest to its end */
+#define MIXER_VOICES 64
+/* Commands the game thread can queue between two audio blocks */
+#define MIXER_QUEUE 256
+
+/* One-shot sound effects mixed over the music.
+ * Sounds are mono float buffers registered up front. play() is called on
+ * the game thread and only pushes onto a lock-free single producer queue;
+ * mix() runs on the audio thread, starts what was queued and adds every
+ * playing voice into a stereo float block, without allocating. */
+class Mixer {
+	public:
+		Mixer();
+
+		/* Register a mono sound at the output rate before playback starts.
+		   Returns its id. */
+		int addSound(const std::vector<float> &samples);
+		/* Samples of a registered sound, empty for an unknown id */
+		const std::vector<float> &sound(int id) const;
+
+		/* Game thread: start sound with gain and pan (-1 left .. 1 right).
+		   Returns 0 if the queue is full and the sound was dropped. */
+		int play(int sound, float gain = 1, float pan = 0);
+
+		/* Audio thread: add the voices into frames of interleaved stereo */
+		void mix(float *out, int frames);
+
+		/* Audio thread: whether play() queued anything since the last mix() */
+		int pending() const { return head.load(std::memory_order_acquire) != tail.load(std::memory_order_relaxed); }
+		int activeVoices() const { return active; }
+		long long stolen() const { return steal_count; }
+		long long dropped() const { return drop_count; }
+
+	private:
+		struct Command {
+			int sound;
+			float gain, pan;
+		};
+		struct Voice {
+			const float *samples;
+			int length, pos;
+			float left, right;
+		};
+
+		void start(const Command &command);
+
+		std::vector<std::vector<float> > sounds;
+		std::vector<float> none;
+		Voice voices[MIXER_VOICES];
+		int active;
+		Command queue[MIXER_QUEUE];
+		alignas(64) std::atomic<unsigned> head; // commands pushed, game thread only
+		alignas(64) std::atomic<unsigned> tail; // commands taken, audio thread only
+		std::atomic<long long> steal_count, drop_count;
+};
+
+/* Kernels of the mix, vectorised with SSE2 where available.
+   mixMono: out[2i] += in[i] * left, out[2i+1] += in[i] * right */
+void mixMono(float *out, const float *in, int frames, float left, float right);
+/* Between 16-bit samples and floats in -1..1, clamping on the way back */
+void pcmToFloat(float *out, const short *in, int samples);
+void floatToPcm(short *out, const float *in, int samples);
+
+#endif
@@ -4,6 +4,7 @@
 #include <vector>
 #include <algorithm>
 #include <string>
+#include <cstring>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -16,14 +17,22 @@
 #include <glm/gtx/transform.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
-#include <ao/ao.h>
-#include <mpg123.h>
 #include <unistd.h>
-#include <signal.h>
 
-#define BITS 8
-
-pid_t pid;
+#include "game.h"
+#include "jobsystem.h"
+#include "framepacer.h"
+#include "textures.h"
+#include "shaders.h"
+#include "resources.h"
+#include "pack.h"
+#include "assets.h"
+#include "trace.h"
+#include "shaderwatch.h"
+#include "audio.h"
+#include "drawlist.h"
+#include "overdraw.h"
+#include "renderscale.h"
 
 #define TOP_VIEW 1
 #define TOWER_VIEW 2
@@ -32,24 +41,24 @@ pid_t pid;
 #define HELI_VIEW 5
 #define PORTAL_VIEW 6
 
-#define BLOCK_TOP_LIMIT 120
-
 using namespace std;
 void reshapeWindow (GLFWwindow* window, int width, int height);
 
-int checkPlayerOnBlock();
 class VAO {
 	public:
 		GLuint VertexArrayID;
 		GLuint VertexBuffer;
 		GLuint ColorBuffer;
 		GLuint TextureBuffer;
-		GLuint TextureID;
+		int TextureAsset; // id in assets, resolved when drawn
 
 		GLenum PrimitiveMode;
 		GLenum FillMode;
 		int NumVertices;
 
+		// Keeps the shared buffers alive while this object exists
+		ResourceHandle mesh;
+
 		VAO(){
 		}
 };
@@ -69,83 +78,84 @@ struct FTGLFont {
 	GLuint fontColorID;
 } GL3Font;
 
-GLuint programID, fontProgramID, textureProgramID;;
-
-/* Function to load Shaders - Use it as it is */
-GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path) {
-
-	// Create the shaders
-	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-	GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
-
-	// Read the Vertex Shader code from the file
-	std::string VertexShaderCode;
-	std::ifstream VertexShaderStream(vertex_file_path, std::ios::in);
-	if(VertexShaderStream.is_open())
-	{
-		std::string Line = "";
-		while(getline(VertexShaderStream, Line))
-			VertexShaderCode += "\n" + Line;
-		VertexShaderStream.close();
-	}
+ShaderProgram colourProgram("Sample_GL.vert", "Sample_GL.frag");
+ShaderProgram fontProgram("fontrender.vert", "fontrender.frag");
+/* TextureRender built once per lighting mode, so each level only runs the
+   lighting it shows. Indexed by levelLighting(). */
+#define LIGHTING_NONE 0
+#define LIGHTING_SPOT 1
+#define LIGHTING_DIM 2
+#define LIGHTING_SPOT_SMOOTH 3
+#define LIGHTING_MODES 4
+ShaderProgram texturePrograms[LIGHTING_MODES] = {
+	ShaderProgram("TextureRender.vert", "TextureRender.frag"),
+	ShaderProgram("TextureRender.vert", "TextureRender.frag", "LIGHT_SPOT"),
+	ShaderProgram("TextureRender.vert", "TextureRender.frag", "LIGHT_DIM"),
+	ShaderProgram("TextureRender.vert", "TextureRender.frag", "LIGHT_SPOT LIGHT_SMOOTH"),
+};
+/* Half angle of the level 2 flashlight in degrees, and how far either side
+   of it the smooth variant fades from full beam to ambient */
+#define SPOT_ANGLE 25.0f
+#define SPOT_SOFTNESS 5.0f
+/* ADVENTURA_SPOTLIGHT=smooth */
+int smoothSpotlight = 0;
+/* Music and sound effects */
+AudioSystem *audio;
+/* Rebuilds the programs above when ADVENTURA_WATCH_SHADERS is set */
+ShaderWatcher *shaderWatcher;
+
+/* Frame pacing mode from ADVENTURA_PACING (vsync, uncapped, cap:N, adaptive:N) */
+FramePacer pacer;
+
+/* Every texture and mesh buffer in use; objects with identical data share them */
+ResourceManager resources;
+/* Texture resolution from ADVENTURA_QUALITY and ADVENTURA_TEXTURE_BUDGET */
+TextureQuality quality;
+// Baked by tools/texbake; any image missing from it or changed since is decoded from PNG
+TextureCache textureCache;
+/* Textures, loaded per level or on first use */
+AssetSet *assets;
+
+/* Textured draws of the frame, opaque ones ordered by ADVENTURA_DRAW_ORDER */
+DrawList opaque, blended;
+int drawOrder = DRAW_SORTED;
+/* ADVENTURA_OVERDRAW: every frame is counted in code order and as drawn */
+#define OVERDRAW_CODE 0
+#define OVERDRAW_DRAWN 1
+OverdrawCounter *overdraw;
+/* ADVENTURA_RENDER_SCALE: the 3D scene at a fixed or adaptive fraction of the resolution */
+RenderScale renderScale;
+
+static VAO* createVAO (GLenum primitive_mode, int numVertices, const ResourceHandle &mesh, GLenum fill_mode)
+{
+	VAO* vao = new VAO();
+	vao->PrimitiveMode = primitive_mode;
+	vao->NumVertices = numVertices;
+	vao->FillMode = fill_mode;
+	vao->mesh = mesh;
+	const MeshBuffers &buffers = resources.meshBuffers(mesh);
+	vao->VertexArrayID = buffers.VertexArrayID;
+	vao->VertexBuffer = buffers.VertexBuffer;
+	vao->ColorBuffer = buffers.ColorBuffer;
+	vao->TextureBuffer = buffers.TextureBuffer;
+	vao->TextureAsset = -1;
+	return vao;
+}
 
-	// Read the Fragment Shader code from the file
-	std::string FragmentShaderCode;
-	std::ifstream FragmentShaderStream(fragment_file_path, std::ios::in);
-	if(FragmentShaderStream.is_open()){
-		std::string Line = "";
-		while(getline(FragmentShaderStream, Line))
-			FragmentShaderCode += "\n" + Line;
-		FragmentShaderStream.close();
+/* Write frame time statistics to ADVENTURA_FRAMESTATS ("-" for stdout), if set */
+void dumpFrameStats()
+{
+	const char *path = getenv("ADVENTURA_FRAMESTATS");
+	if(!path)
+		return;
+	FILE *out = strcmp(path, "-") ? fopen(path, "w") : stdout;
+	if(!out){
+		fprintf(stderr, "Could not write frame stats to %s\n", path);
+		return;
 	}
-
-	GLint Result = GL_FALSE;
-	int InfoLogLength;
-
-	// Compile Vertex Shader
-	printf("Compiling shader : %s\n", vertex_file_path);
-	char const * VertexSourcePointer = VertexShaderCode.c_str();
-	glShaderSource(VertexShaderID, 1, &VertexSourcePointer , NULL);
-	glCompileShader(VertexShaderID);
-
-	// Check Vertex Shader
-	glGetShaderiv(VertexShaderID, GL_COMPILE_STATUS, &Result);
-	glGetShaderiv(VertexShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-	std::vector<char> VertexShaderErrorMessage(InfoLogLength);
-	glGetShaderInfoLog(VertexShaderID, InfoLogLength, NULL, &VertexShaderErrorMessage[0]);
-	fprintf(stdout, "%s\n", &VertexShaderErrorMessage[0]);
-
-	// Compile Fragment Shader
-	printf("Compiling shader : %s\n", fragment_file_path);
-	char const * FragmentSourcePointer = FragmentShaderCode.c_str();
-	glShaderSource(FragmentShaderID, 1, &FragmentSourcePointer , NULL);
-	glCompileShader(FragmentShaderID);
-
-	// Check Fragment Shader
-	glGetShaderiv(FragmentShaderID, GL_COMPILE_STATUS, &Result);
-	glGetShaderiv(FragmentShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-	std::vector<char> FragmentShaderErrorMessage(InfoLogLength);
-	glGetShaderInfoLog(FragmentShaderID, InfoLogLength, NULL, &FragmentShaderErrorMessage[0]);
-	fprintf(stdout, "%s\n", &FragmentShaderErrorMessage[0]);
-
-	// Link the program
-	fprintf(stdout, "Linking program\n");
-	GLuint ProgramID = glCreateProgram();
-	glAttachShader(ProgramID, VertexShaderID);
-	glAttachShader(ProgramID, FragmentShaderID);
-	glLinkProgram(ProgramID);
-
-	// Check the program
-	glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
-	glGetProgramiv(ProgramID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-	std::vector<char> ProgramErrorMessage( max(InfoLogLength, int(1)) );
-	glGetProgramInfoLog(ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
-	fprintf(stdout, "%s\n", &ProgramErrorMessage[0]);
-
-	glDeleteShader(VertexShaderID);
-	glDeleteShader(FragmentShaderID);
-
-	return ProgramID;
+	pacer.dump(out);
+	if(out != stdout)
+		fclose(out);
 }
 
 static void error_callback(int error, const char* description)
@@ -155,9 +165,20 @@ static void error_callback(int error, const char* description)
 
 void quit(GLFWwindow *window)
 {
+	dumpFrameStats();
+	if(overdraw){
+		static const char *const names[] = { "code", "drawn" };
+		overdraw->dump(stdout, names);
+	}
+	if(renderScale.active())
+		renderScale.dump(stdout);
+	// Its thread may be compiling in a context that shares with window
+	if(shaderWatcher)
+		shaderWatcher->stop();
 	glfwDestroyWindow(window);
 	glfwTerminate();
-	kill(pid,SIGKILL);
+	audio->report(stdout);
+	audio->stop();
 	exit(EXIT_SUCCESS);
 }
 
@@ -185,96 +206,40 @@ glm::vec3 getRGBfromHue (int hue)
 /* Generate VAO, VBOs and return VAO handle */
 VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, const GLfloat* color_buffer_data, GLenum fill_mode )
 {
-	VAO* vao = new  VAO();
-	vao->PrimitiveMode = primitive_mode;
-	vao->NumVertices = numVertices;
-	vao->FillMode = fill_mode;
-
-	// Create Vertex Array Object
-	// Should be done after CreateWindow and before any other GL calls
-	glGenVertexArrays(1, &(vao->VertexArrayID)); // VAO
-	glGenBuffers (1, &(vao->VertexBuffer)); // VBO - vertices
-	glGenBuffers (1, &(vao->ColorBuffer));  // VBO - colors
-
-	glBindVertexArray (vao->VertexArrayID); // Bind the VAO 
-	glBindBuffer (GL_ARRAY_BUFFER, vao->VertexBuffer); // Bind the VBO vertices 
-	glBufferData (GL_ARRAY_BUFFER, 3*numVertices*sizeof(GLfloat), vertex_buffer_data, GL_STATIC_DRAW); // Copy the vertices into VBO
-	glVertexAttribPointer(
-			0,                  // attribute 0. Vertices
-			3,                  // size (x,y,z)
-			GL_FLOAT,           // type
-			GL_FALSE,           // normalized?
-			0,                  // stride
-			(void*)0            // array buffer offset
-			);
-
-	glBindBuffer (GL_ARRAY_BUFFER, vao->ColorBuffer); // Bind the VBO colors 
-	glBufferData (GL_ARRAY_BUFFER, 3*numVertices*sizeof(GLfloat), color_buffer_data, GL_STATIC_DRAW);  // Copy the vertex colors
-	glVertexAttribPointer(
-			1,                  // attribute 1. Color
-			3,                  // size (r,g,b)
-			GL_FLOAT,           // type
-			GL_FALSE,           // normalized?
-			0,                  // stride
-			(void*)0            // array buffer offset
-			);
-	return vao;
+	ResourceHandle mesh = resources.mesh(numVertices, vertex_buffer_data, color_buffer_data, NULL);
+	return createVAO(primitive_mode, numVertices, mesh, fill_mode);
 }
 
 /* Generate VAO, VBOs and return VAO handle - Common Color for all vertices */
 VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, const GLfloat red, const GLfloat green, const GLfloat blue,  GLenum fill_mode)
 {
-	GLfloat* color_buffer_data = new GLfloat [3*numVertices];
+	vector<GLfloat> color_buffer_data(3*numVertices);
 	for (int i=0; i<numVertices; i++) {
 		color_buffer_data [3*i] = red;
 		color_buffer_data [3*i + 1] = green;
 		color_buffer_data [3*i + 2] = blue;
 	}
 
-	return create3DObject(primitive_mode, numVertices, vertex_buffer_data, color_buffer_data, fill_mode);
+	return create3DObject(primitive_mode, numVertices, vertex_buffer_data, &color_buffer_data[0], fill_mode);
 }
 
 
-struct VAO* create3DTexturedObject (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, const GLfloat* texture_buffer_data, GLuint textureID, GLenum fill_mode=GL_FILL)
+struct VAO* create3DTexturedObject (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, const GLfloat* texture_buffer_data, int textureID, GLenum fill_mode=GL_FILL)
 {
-	struct VAO* vao = new struct VAO;
-	vao->PrimitiveMode = primitive_mode;
-	vao->NumVertices = numVertices;
-	vao->FillMode = fill_mode;
-	vao->TextureID = textureID;
-
-	// Create Vertex Array Object
-	// Should be done after CreateWindow and before any other GL calls
-	glGenVertexArrays(1, &(vao->VertexArrayID)); // VAO
-	glGenBuffers (1, &(vao->VertexBuffer)); // VBO - vertices
-	glGenBuffers (1, &(vao->TextureBuffer));  // VBO - textures
-
-	glBindVertexArray (vao->VertexArrayID); // Bind the VAO
-	glBindBuffer (GL_ARRAY_BUFFER, vao->VertexBuffer); // Bind the VBO vertices
-	glBufferData (GL_ARRAY_BUFFER, 3*numVertices*sizeof(GLfloat), vertex_buffer_data, GL_STATIC_DRAW); // Copy the vertices into VBO
-	glVertexAttribPointer(
-			0,                  // attribute 0. Vertices
-			3,                  // size (x,y,z)
-			GL_FLOAT,           // type
-			GL_FALSE,           // normalized?
-			0,                  // stride
-			(void*)0            // array buffer offset
-			);
-
-	glBindBuffer (GL_ARRAY_BUFFER, vao->TextureBuffer); // Bind the VBO textures
-	glBufferData (GL_ARRAY_BUFFER, 2*numVertices*sizeof(GLfloat), texture_buffer_data, GL_STATIC_DRAW);  // Copy the vertex colors
-	glVertexAttribPointer(
-			2,                  // attribute 2. Textures
-			2,                  // size (s,t)
-			GL_FLOAT,           // type
-			GL_FALSE,           // normalized?
-			0,                  // stride
-			(void*)0            // array buffer offset
-			);
-
+	ResourceHandle mesh = resources.mesh(numVertices, vertex_buffer_data, NULL, texture_buffer_data);
+	VAO* vao = createVAO(primitive_mode, numVertices, mesh, fill_mode);
+	vao->TextureAsset = textureID;
 	return vao;
 }
 
+/* Textured triangles sampling image, its UVs moved into image.rect */
+struct VAO* createAtlasObject (int numVertices, const GLfloat* vertex_buffer_data, const GLfloat* texture_buffer_data, const AtlasImage &image)
+{
+	vector<GLfloat> uv(2*numVertices);
+	remapUV(texture_buffer_data, numVertices, image.rect, &uv[0]);
+	return create3DTexturedObject(GL_TRIANGLES, numVertices, vertex_buffer_data, &uv[0], image.texture, GL_FILL);
+}
+
 /* Render the VBOs handled by VAO */
 void draw3DObject (VAO* vao)
 {
@@ -298,6 +263,9 @@ void draw3DObject (VAO* vao)
 	glDrawArrays(vao->PrimitiveMode, 0, vao->NumVertices); // Starting from vertex 0; 3 vertices total -> 1 triangle
 }
 
+// Texture bound by draw3DTexturedObject, reset at the start of every frame
+GLuint boundTexture;
+
 void draw3DTexturedObject (struct VAO* vao)
 {
 	// Change the Fill Mode for this object
@@ -311,8 +279,15 @@ void draw3DTexturedObject (struct VAO* vao)
 	// Bind the VBO to use
 	glBindBuffer(GL_ARRAY_BUFFER, vao->VertexBuffer);
 
-	// Bind Textures using texture units
-	glBindTexture(GL_TEXTURE_2D, vao->TextureID);
+	// Bind Textures using texture units, unless it is still bound from the
+	// last object (everything sampling the atlas shares one bind)
+	if(!assets->resident(vao->TextureAsset))
+		boundTexture = 0; // loading it on first use leaves no texture bound
+	GLuint TextureID = assets->texture(vao->TextureAsset);
+	if(TextureID != boundTexture){
+		glBindTexture(GL_TEXTURE_2D, TextureID);
+		boundTexture = TextureID;
+	}
 
 	// Enable Vertex Attribute 2 - Texture
 	glEnableVertexAttribArray(2);
@@ -321,36 +296,56 @@ void draw3DTexturedObject (struct VAO* vao)
 
 	// Draw the geometry !
 	glDrawArrays(vao->PrimitiveMode, 0, vao->NumVertices); // Starting from vertex 0; 3 vertices total -> 1 triangle
+}
 
-	// Unbind Textures to be safe
-	glBindTexture(GL_TEXTURE_2D, 0);
+/* Issue queued textured draws with the texture program in use */
+void drawQueued (ShaderProgram &program, const DrawList &list)
+{
+	GLint position = program.uniform("objectPosition");
+	for(int d=0;d<list.size();d++){
+		const DrawItem &item = list[d];
+		glUniformMatrix4fv(Matrices.TexMatrixID, 1, GL_FALSE, &item.MVP[0][0]);
+		glUniform3f(position, item.position.x, item.position.y, item.position.z);
+		draw3DTexturedObject(item.vao);
+	}
 }
 
-/* Create an OpenGL Texture from an image */
-GLuint createTexture (const char* filename)
+/* Lay down only the depth of the queued draws, with the colour program as the
+   cheapest one at hand, so the texture pass shades every pixel once */
+void drawDepth (const DrawList &list)
 {
-	GLuint TextureID;
-	// Generate Texture Buffer
-	glGenTextures(1, &TextureID);
-	// All upcoming GL_TEXTURE_2D operations now have effect on our texture buffer
-	glBindTexture(GL_TEXTURE_2D, TextureID);
-	// Set our texture parameters
-	// Set texture wrapping to GL_REPEAT
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	// Set texture filtering (interpolation)
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-	// Load image and create OpenGL texture
-	int twidth, theight;
-	unsigned char* image = SOIL_load_image(filename, &twidth, &theight, 0, SOIL_LOAD_RGBA);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, twidth, theight, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-	glGenerateMipmap(GL_TEXTURE_2D); // Generate MipMaps to use
-	SOIL_free_image_data(image); // Free the data read from file after creating opengl texture
-	glBindTexture(GL_TEXTURE_2D, 0); // Unbind texture when done, so we won't accidentily mess it up
-
-	return TextureID;
+	glUseProgram(colourProgram.id);
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glStencilMask(0); // not counted as shading by ADVENTURA_OVERDRAW
+	for(int d=0;d<list.size();d++){
+		const DrawItem &item = list[d];
+		glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &item.MVP[0][0]);
+		glPolygonMode(GL_FRONT_AND_BACK, item.vao->FillMode);
+		glBindVertexArray(item.vao->VertexArrayID);
+		glDrawArrays(item.vao->PrimitiveMode, 0, item.vao->NumVertices);
+	}
+	glStencilMask(0xFF);
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
+
+/* The queued frame: opaque draws, after their depth if prepass, then blended ones */
+void drawScene (ShaderProgram &program, int prepass)
+{
+	if(prepass)
+		drawDepth(opaque);
+	glUseProgram(program.id);
+	drawQueued(program, opaque);
+	drawQueued(program, blended);
+}
+
+/* Draw the queued frame offscreen and count the fragments it shades */
+void countOverdraw (ShaderProgram &program, int pass, int prepass)
+{
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	overdraw->begin(viewport[2], viewport[3]);
+	drawScene(program, prepass);
+	overdraw->end(pass);
 }
 
 /**************************
@@ -359,53 +354,25 @@ GLuint createTexture (const char* filename)
 
 float screenleft = -600.0f, screenright = 600.0f, screentop = -300.0f, screenbotton = 300.0f, screennear = -500.0f, screenfar = 600.0f;
 double curx, cury, initx, inity;
-int movefront = 0, moveback = 0, moveleft = 0, moveright = 0;
-char gamemat[11][11];
 int camera_view =  ADV_VIEW;
 int camera_switch_state = 0;
 int saved_camera;
-int turn_right = 0, turn_left = 0, jump = 0;
-float speedy = 0;
 /* Executed when a regular key is pressed/released/held-down */
 /* Prefered for Keyboard events */
 
-int falling = 0;
-float edge = 20, nvert = 10, nhor = 10;
-float playerposx = edge*(-nhor/2) + edge/2;
-float playerposy = 10;
-float playerposz = edge*(-nvert/2) + (nvert - 1)*edge + edge/2;
-float playerAngle = 0;
+// Everything the simulation needs; the rest of this file only presents it
+GameInstance game;
+float &edge = game.course.edge, &nvert = game.course.nvert, &nhor = game.course.nhor;
+// Autonomous adventurers (--agents N), updated in parallel on the job system
+vector<Agent> crowd;
+JobSystem *jobs;
 float heli_angle, init_heli_angle;
 int heli_rotate_state = 0, heli_zoom_in_state = 0, heli_zoom_out_state = 0;
 float heli_dist = 180, heli_disty = 200;
 
 int font_state = 0;
-int open_portal = 0;
-float portal_pos = -10;
 
-vector<pair<int,int> > holes, blocks, imblocks, treasure, impos;
 
-int playerOnGround(){
-	if(playerposy == 10)
-		return 1;
-	for(int p = 0;p<blocks.size();p++){
-		int i = blocks[p].first, j = blocks[p].second;
-		float xpos = edge*(-nhor/2) + j*edge + edge/2;
-		float ypos = 10;
-		float zpos = edge*(-nvert/2) + i*edge + edge/2;
-
-		if(playerposx + edge/4 > xpos - edge/2 &&
-				playerposx - edge/4 < xpos + edge/2 &&
-				playerposz + edge/4 > zpos - edge/2 &&
-				playerposz - edge/4 < zpos + edge/2 &&
-				playerposy - edge/2 <= ypos + edge/2
-		  ){
-			playerposy = ypos + edge;
-			return 1;
-		}
-	}
-	return 0;
-}
 void keyboard (GLFWwindow* window, int key, int scancode, int action, int mods)
 {
 	// Function is called first on GLFW_PRESS.
@@ -432,10 +399,10 @@ void keyboard (GLFWwindow* window, int key, int scancode, int action, int mods)
 				heli_angle = 0;
 				break;
 			case GLFW_KEY_4:
-				turn_left = 0;
+				game.player.turn_left = 0;
 				break;
 			case GLFW_KEY_6:
-				turn_right = 0;
+				game.player.turn_right = 0;
 				break;
 			case GLFW_KEY_KP_ADD:
 				heli_zoom_in_state = 0;
@@ -445,19 +412,19 @@ void keyboard (GLFWwindow* window, int key, int scancode, int action, int mods)
 				heli_zoom_out_state = 0;
 				break;
 			case GLFW_KEY_LEFT:
-				moveleft = 0;
+				game.player.moveleft = 0;
 				//				panleft = 0;
 				break;
 			case GLFW_KEY_RIGHT:
-				moveright = 0;
+				game.player.moveright = 0;
 				//				panright = 0;
 				break;
 			case GLFW_KEY_UP:
-				movefront = 0;
+				game.player.movefront = 0;
 				//				panup = 0;
 				break;
 			case GLFW_KEY_DOWN:
-				moveback = 0;
+				game.player.moveback = 0;
 				//				pandown = 0;
 				break;
 			case GLFW_KEY_X:
@@ -481,31 +448,30 @@ void keyboard (GLFWwindow* window, int key, int scancode, int action, int mods)
 				//				zoomoutstate = 1;
 				break;
 			case GLFW_KEY_LEFT:
-				moveleft = 1;
+				game.player.moveleft = 1;
 				//				panleft = 1;
 				break;
 			case GLFW_KEY_RIGHT:
-				moveright = 1;
+				game.player.moveright = 1;
 				//				panright = 1;
 				break;
 			case GLFW_KEY_UP:
-				movefront = 1;
+				game.player.movefront = 1;
 				//				panup = 1;
 				break;
 			case GLFW_KEY_DOWN:
-				moveback = 1;
+				game.player.moveback = 1;
 				//				pandown = 1;
 				break;
 			case GLFW_KEY_4:
-				turn_left = 1;
+				game.player.turn_left = 1;
 				break;
 			case GLFW_KEY_6:
-				turn_right = 1;
+				game.player.turn_right = 1;
 				break;
 			case GLFW_KEY_SPACE:
-				if(playerOnGround() || checkPlayerOnBlock()){
-					speedy = 5, jump = 1;
-				}
+				if(jumpAgent(game.course, game.player))
+					audio->play(SOUND_JUMP);
 			default:
 				break;
 		}
@@ -540,9 +506,9 @@ static void cursor_position_callback(GLFWwindow* window, double xpos, double ypo
 {
 	if(camera_view == ADV_VIEW){
 		if(curx > xpos)
-			playerAngle--;
+			game.player.angle--;
 		if(curx < xpos)
-			playerAngle++;
+			game.player.angle++;
 	}
 	curx = xpos;
 	cury = ypos;
@@ -612,10 +578,10 @@ void reshapeWindow (GLFWwindow* window, int width, int height)
 
 
 float camera_rotation_angle = 90;
-VAO *block, *block_layer[6], *background[6], *player, *rotBlock[6], *oscillator[6], *portal_block, *portal_block2, 
+VAO *block, *block_layer[6], *background[6], *rotBlock[6], *oscillator[6], *portal_block, *portal_block2, 
     *head_block[6], *body_block[6], *handl_block[6], *eye_layer, *treasure_block[6];
-void createRotatingBlock(GLuint textureID, GLuint textureID2, GLuint textureID3,GLuint textureID5,GLuint textureID4, GLuint textureID6, 
-		GLuint headT, GLuint bodyT, GLuint handlT, GLuint treasureT){
+void createRotatingBlock(int textureID, int textureID2, int textureID3,int textureID5,int textureID4, int textureID6, 
+		const AtlasImage &headT, const AtlasImage &bodyT, const AtlasImage &handlT, const AtlasImage &treasureT){
 	static const GLfloat vertex_buffer_data0[] = {
 		-10, 10, 10,
 		-10, -10, 10,
@@ -638,10 +604,10 @@ void createRotatingBlock(GLuint textureID, GLuint textureID2, GLuint textureID3,
 	rotBlock[0] = create3DTexturedObject(GL_TRIANGLES, 6, vertex_buffer_data0, texture_buffer_data0, textureID, GL_FILL);
 	oscillator[0] = create3DTexturedObject(GL_TRIANGLES, 6, vertex_buffer_data0, texture_buffer_data0, textureID6, GL_FILL);
 	block_layer[0] = create3DTexturedObject(GL_TRIANGLES, 6, vertex_buffer_data0, texture_buffer_data0, textureID4, GL_FILL);
-	head_block[0] = create3DTexturedObject(GL_TRIANGLES, 6, vertex_buffer_data0, texture_buffer_data0, headT, GL_FILL);
-	body_block[0] = create3DTexturedObject(GL_TRIANGLES, 6, vertex_buffer_data0, texture_buffer_data0, bodyT, GL_FILL);
-	handl_block[0] = create3DTexturedObject(GL_TRIANGLES, 6, vertex_buffer_data0, texture_buffer_data0, handlT, GL_FILL);
-	treasure_block[0] = create3DTexturedObject(GL_TRIANGLES, 6, vertex_buffer_data0, texture_buffer_data0, treasureT, GL_FILL);
+	head_block[0] = createAtlasObject(6, vertex_buffer_data0, texture_buffer_data0, headT);
+	body_block[0] = createAtlasObject(6, vertex_buffer_data0, texture_buffer_data0, bodyT);
+	handl_block[0] = createAtlasObject(6, vertex_buffer_data0, texture_buffer_data0, handlT);
+	treasure_block[0] = createAtlasObject(6, vertex_buffer_data0, texture_buffer_data0, treasureT);
 
 	static const GLfloat vertex_buffer_data1[] = {
 		-10, 10, -10,
@@ -664,10 +630,10 @@ void createRotatingBlock(GLuint textureID, GLuint textureID2, GLuint textureID3,
 	rotBlock[1] = create3DTexturedObject(GL_TRIANGLES, 6, vertex_buffer_data1, texture_buffer_data1, textureID, GL_FILL);
 	oscillator[1] = create3DTexturedObject(GL_TRIANGLES, 6, vertex_buffer_data1, texture_buffer_data1, textureID6, GL_FILL);
 	block_layer[1] = create3DTexturedObject(GL_TRIANGLES, 6, vertex_buffer_data1, texture_buffer_data1, textureID4, GL_FILL);
-	head_block[1] = create3DTexturedObject(GL_TRIANGLES, 6, vertex_buffer_data1, texture_buffer_data1, headT, GL_FILL);
-	body_block[1] = create3DTexturedObject(GL_TRIANGLES, 6, vertex_buffer_data1, texture_buffer_data1, bodyT, GL_FILL);
-	handl_block[1] = create3DTexturedObject(GL_TRIANGLES, 6, vertex_buffer_data1, texture_buffer_data1, handlT, GL_FILL);
-	treasure_block[1] = create3DTexturedObject(GL_TRIANGLES, 6, vertex_buffer_data1, texture_buffer_data1, treasureT, GL_FILL);
+	head_block[1] = createAtlasObject(6, vertex_buffer_data1, texture_buffer_data1, headT);
+	body_block[1] = createAtlasObject(6, vertex_buffer_data1, texture_buffer_data1, bodyT);
+	handl_block[1] = createAtlasObject(6, vertex_buffer_data1, texture_buffer_data1, handlT);
+	treasure_block[1] = createAtlasObject(6, vertex_buffer_data1, texture_buffer_data1, treasureT);
 
 	static const GLfloat vertex_buffer_data2[] = {
 		10, 10, 10,
@@ -690,10 +656,10 @@ void createRotatingBlock(GLuint textureID, GLuint textureID2, GLuint textureID3,
 	rotBlock[2] = create3DTexturedObject(GL_TRIANGLES, 6, vertex_buffer_data2, texture_buffer_data2, textureID, GL_FILL);
 	oscillator[2] = create3DTexturedObject(GL_TRIANGLES, 6, vertex_buffer_data2, texture_buffer_data2, textureID6, GL_FILL);
 	block_layer[2] = create3DTexturedObject(GL_TRIANGLES, 6, vertex_buffer_data2, texture_buffer_data2, textureID4, GL_FILL);
-	head_block[2] = create3DTexturedObject(GL_TRIANGLES, 6, vertex_buffer_data2, texture_buffer_data2, headT, GL_FILL);
-	body_block[2] = create3DTexturedObject(GL_TRIANGLES, 6, vertex_buffer_data2, texture_buffer_data2, bodyT, GL_FILL);
-	handl_block[2] = create3DTexturedObject(GL_TRIANGLES, 6, vertex_buffer_data2, texture_buffer_data2, handlT, GL_FILL);
-	treasure_block[2] = create3DTexturedObject(GL_TRIANGLES, 6, vertex_buffer_data2, texture_buffer_data2, treasureT, GL_FILL);
+	head_block[2] = createAtlasObject(6, vertex_buffer_data2, texture_buffer_data2, headT);
+	body_block[2] = createAtlasObject(6, vertex_buffer_data2, texture_buffer_data2, bodyT);
+	handl_block[2] = createAtlasObject(6, vertex_buffer_data2, texture_buffer_data2, handlT);
+	treasure_block[2] = createAtlasObject(6, vertex_buffer_data2, texture_buffer_data2, treasureT);
 
 	static const GLfloat vertex_buffer_data3[] = {
 		-10, 10, 10,
@@ -716,10 +682,10 @@ void createRotatingBlock(GLuint textureID, GLuint textureID2, GLuint textureID3,
 	rotBlock[3] = create3DTexturedObject(GL_TRIANGLES, 6, vertex_buffer_data3, texture_buffer_data3, textureID, GL_FILL);
 	oscillator[3] = create3DTexturedObject(GL_TRIANGLES, 6, vertex_buffer_data3, texture_buffer_data3, textureID6, GL_FILL);
 	block_layer[3] = create3DTexturedObject(GL_TRIANGLES, 6, vertex_buffer_data3, texture_buffer_data3, textureID4, GL_FILL);
-	head_block[3] = create3DTexturedObject(GL_TRIANGLES, 6, vertex_buffer_data3, texture_buffer_data3, headT, GL_FILL);
-	body_block[3] = create3DTexturedObject(GL_TRIANGLES, 6, vertex_buffer_data3, texture_buffer_data3, bodyT, GL_FILL);
-	handl_block[3] = create3DTexturedObject(GL_TRIANGLES, 6, vertex_buffer_data3, texture_buffer_data3, handlT, GL_FILL);
-	treasure_block[3] = create3DTexturedObject(GL_TRIANGLES, 6, vertex_buffer_data3, texture_buffer_data3, treasureT, GL_FILL);
+	head_block[3] = createAtlasObject(6, vertex_buffer_data3, texture_buffer_data3, headT);
+	body_block[3] = createAtlasObject(6, vertex_buffer_data3, texture_buffer_data3, bodyT);
+	handl_block[3] = createAtlasObject(6, vertex_buffer_data3, texture_buffer_data3, handlT);
+	treasure_block[3] = createAtlasObject(6, vertex_buffer_data3, texture_buffer_data3, treasureT);
 
 	static const GLfloat vertex_buffer_data4[] = {
 		-10, 10, 10,
@@ -742,12 +708,12 @@ void createRotatingBlock(GLuint textureID, GLuint textureID2, GLuint textureID3,
 	rotBlock[4] = create3DTexturedObject(GL_TRIANGLES, 6, vertex_buffer_data4, texture_buffer_data4, textureID2, GL_FILL);
 	oscillator[4] = create3DTexturedObject(GL_TRIANGLES, 6, vertex_buffer_data4, texture_buffer_data4, textureID3, GL_FILL);
 	block_layer[4] = create3DTexturedObject(GL_TRIANGLES, 6, vertex_buffer_data4, texture_buffer_data4, textureID5, GL_FILL);
-	head_block[4] = create3DTexturedObject(GL_TRIANGLES, 6, vertex_buffer_data4, texture_buffer_data4, headT, GL_FILL);
-	body_block[4] = create3DTexturedObject(GL_TRIANGLES, 6, vertex_buffer_data4, texture_buffer_data4, bodyT, GL_FILL);
-	handl_block[4] = create3DTexturedObject(GL_TRIANGLES, 6, vertex_buffer_data4, texture_buffer_data4, handlT, GL_FILL);
-	treasure_block[4] = create3DTexturedObject(GL_TRIANGLES, 6, vertex_buffer_data4, texture_buffer_data4, treasureT, GL_FILL);
+	head_block[4] = createAtlasObject(6, vertex_buffer_data4, texture_buffer_data4, headT);
+	body_block[4] = createAtlasObject(6, vertex_buffer_data4, texture_buffer_data4, bodyT);
+	handl_block[4] = createAtlasObject(6, vertex_buffer_data4, texture_buffer_data4, handlT);
+	treasure_block[4] = createAtlasObject(6, vertex_buffer_data4, texture_buffer_data4, treasureT);
 }
-void createportal(GLuint textureID, GLuint textureID2){
+void createportal(const AtlasImage &textureID, const AtlasImage &textureID2){
 	static const GLfloat vertex_buffer_data0[] = {
 		-10, 10, 0,
 		-10, -10, 0,
@@ -767,10 +733,10 @@ void createportal(GLuint textureID, GLuint textureID2){
 		1, 0,
 		1, 1,
 	};
-	portal_block = create3DTexturedObject(GL_TRIANGLES, 6, vertex_buffer_data0, texture_buffer_data0, textureID, GL_FILL);
-	portal_block2 = create3DTexturedObject(GL_TRIANGLES, 6, vertex_buffer_data0, texture_buffer_data0, textureID2, GL_FILL);
+	portal_block = createAtlasObject(6, vertex_buffer_data0, texture_buffer_data0, textureID);
+	portal_block2 = createAtlasObject(6, vertex_buffer_data0, texture_buffer_data0, textureID2);
 }
-void createEye(GLuint textureID){
+void createEye(const AtlasImage &textureID){
 	static const GLfloat vertex_buffer_data0[] = {
 		-10, 10, 0,
 		-10, -10, 0,
@@ -790,11 +756,11 @@ void createEye(GLuint textureID){
 		1, 0,
 		1, 1,
 	};
-	eye_layer = create3DTexturedObject(GL_TRIANGLES, 6, vertex_buffer_data0, texture_buffer_data0, textureID, GL_FILL);
+	eye_layer = createAtlasObject(6, vertex_buffer_data0, texture_buffer_data0, textureID);
 }
 
 int skyposy = 250, skyposx = 300, skyposz = 300;
-void createBackground(GLuint *textureID){
+void createBackground(const int *textureID){
 	static const GLfloat vertex_buffer_data[] = {
 		-skyposx, skyposy, -skyposz,
 		-skyposx, -skyposy, -skyposz,
@@ -878,15 +844,33 @@ float dist = 200;
 float angle = 0;
 float zdist = 200;
 
+/* Which TextureRender variant lights a level */
+static int levelLighting (int level)
+{
+	if(level == 2)
+		return smoothSpotlight ? LIGHTING_SPOT_SMOOTH : LIGHTING_SPOT;
+	if(level == 3)
+		return LIGHTING_DIM;
+	return LIGHTING_NONE;
+}
+
 void draw (GLFWwindow* window, int level)
 {
+	if(renderScale.active()){
+		int fbwidth, fbheight;
+		glfwGetFramebufferSize(window, &fbwidth, &fbheight);
+		renderScale.begin(fbwidth, fbheight);
+	}
 	// clear the color and depth in the frame buffer
 	glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	// Text rendering and loading may have bound other textures since
+	boundTexture = 0;
+	glBindTexture(GL_TEXTURE_2D, 0);
 
 
 	// use the loaded shader program
 	// Don't change unless you know what you are doing
-	glUseProgram (programID);
+	glUseProgram (colourProgram.id);
 
 	// Eye - Location of camera. Don't change unless you are sure!!
 	glm::vec3 eye ( 5*cos(camera_rotation_angle*M_PI/180.0f), 0, 5*sin(camera_rotation_angle*M_PI/180.0f) );
@@ -904,22 +888,22 @@ void draw (GLFWwindow* window, int level)
 		case ADV_VIEW:
 			Matrices.view = glm::lookAt(
 					glm::vec3(
-						playerposx + (edge/2) * sin(playerAngle * M_PI/180.0f),
-						playerposy,
-						playerposz - (edge/2) * cos(playerAngle * M_PI/180.0f) 
+						game.player.posx + (edge/2) * sin(game.player.angle * M_PI/180.0f),
+						game.player.posy,
+						game.player.posz - (edge/2) * cos(game.player.angle * M_PI/180.0f) 
 						), 
-					glm::vec3(playerposx + 100 * sin(playerAngle*M_PI/180.0f), 0 ,playerposz - 100 * cos(playerAngle*M_PI/180.0f)), 
+					glm::vec3(game.player.posx + 100 * sin(game.player.angle*M_PI/180.0f), 0 ,game.player.posz - 100 * cos(game.player.angle*M_PI/180.0f)), 
 					glm::vec3(0,1,0)
 					);
 			break;
 		case FOLLOW_VIEW:
 			Matrices.view = glm::lookAt(
 					glm::vec3(
-						playerposx - edge * sin(playerAngle * M_PI/180.0f),
-						playerposy + edge,
-						playerposz + edge * cos(playerAngle * M_PI/180.0f)
+						game.player.posx - edge * sin(game.player.angle * M_PI/180.0f),
+						game.player.posy + edge,
+						game.player.posz + edge * cos(game.player.angle * M_PI/180.0f)
 						), 
-					glm::vec3(playerposx + 100 * sin(playerAngle*M_PI/180.0f), 0 ,playerposz - 100 * cos(playerAngle*M_PI/180.0f)), 
+					glm::vec3(game.player.posx + 100 * sin(game.player.angle*M_PI/180.0f), 0 ,game.player.posz - 100 * cos(game.player.angle*M_PI/180.0f)), 
 					glm::vec3(0,1,0)
 					);
 			break;
@@ -941,7 +925,7 @@ void draw (GLFWwindow* window, int level)
 				heli_dist++, heli_disty++;
 			break;
 		case PORTAL_VIEW:
-			Matrices.view = glm::lookAt(glm::vec3(120 ,120,0), glm::vec3(edge * (nhor/2) - edge/2,portal_pos, edge *(-nvert/2) + edge/2), glm::vec3(0,1,0));
+			Matrices.view = glm::lookAt(glm::vec3(120 ,120,0), glm::vec3(edge * (nhor/2) - edge/2,game.portal_pos, edge *(-nvert/2) + edge/2), glm::vec3(0,1,0));
 			break;
 
 	}
@@ -963,27 +947,32 @@ void draw (GLFWwindow* window, int level)
 
 
 	//Displaying background using texture
-	glUseProgram(textureProgramID);
-
+	int lighting = levelLighting(level);
+	ShaderProgram &textureProgram = texturePrograms[lighting];
+	glUseProgram(textureProgram.id);
+	Matrices.TexMatrixID = textureProgram.uniform("MVP");
+	// Only the spotlight variants read these, the others have no such uniforms
+	float soft = lighting == LIGHTING_SPOT_SMOOTH ? SPOT_SOFTNESS : 0;
+	glUniform3f(textureProgram.uniform("playerPosition"), game.player.posx, game.player.posy, game.player.posz);
+	glUniform3f(textureProgram.uniform("spotDirection"), sin(game.player.angle*M_PI/180.0f), 0, -cos(game.player.angle*M_PI/180.0f));
+	glUniform1f(textureProgram.uniform("spotCutoff"), cos((SPOT_ANGLE + soft)*M_PI/180.0f));
+	glUniform1f(textureProgram.uniform("spotInner"), cos((SPOT_ANGLE - soft)*M_PI/180.0f));
+
+	// Queued and drawn below, so opaque draws can be reordered
+	opaque.clear();
+	blended.clear();
+	glm::vec3 lit; // objectPosition of the draws that follow
 	Matrices.model = glm::mat4(1.0f);
 	MVP = VP * Matrices.model;
-	glUniformMatrix4fv(Matrices.TexMatrixID, 1, GL_FALSE, &MVP[0][0]);
-	glUniform1i(glGetUniformLocation(textureProgramID, "texSampler"), 0);
+	glUniform1i(textureProgram.uniform("texSampler"), 0);
 	for(int i=0;i<6;i++){
-		GLint myUniformLocation = glGetUniformLocation(textureProgramID, "objectPosition");
-		glUniform3f(myUniformLocation,skyposx,skyposy,skyposz);
-		myUniformLocation = glGetUniformLocation(textureProgramID, "playerPosition");
-		glUniform3f(myUniformLocation,playerposx, playerposy, playerposz);
-		myUniformLocation = glGetUniformLocation(textureProgramID, "playerAngle");
-		glUniform1f(myUniformLocation,playerAngle);
-		myUniformLocation = glGetUniformLocation(textureProgramID, "level");
-		glUniform1f(myUniformLocation,(float)level);
-		draw3DTexturedObject(background[i]);
+		lit = glm::vec3(skyposx,skyposy,skyposz);
+		opaque.add(background[i], MVP, lit, DRAW_FARTHEST);
 	}
 	for(int i=0;i<nhor;i++){
 		for(int j=0;j<nvert;j++){
 			float xpos,ypos,zpos;
-			if(gamemat[i][j] == '.' || gamemat[i][j] == 'B' || gamemat[i][j] == 'T'){
+			if(game.course.gamemat[i][j] == '.' || game.course.gamemat[i][j] == 'B' || game.course.gamemat[i][j] == 'T'){
 				xpos = edge*(-nhor/2) + j*edge + edge/2;
 				ypos = 0.1;
 				zpos = edge*(-nvert/2) + i*edge + edge/2;
@@ -993,22 +982,14 @@ void draw (GLFWwindow* window, int level)
 				glm::mat4 scl = glm::scale(glm::vec3(1,10,1));
 				Matrices.model *= ( translateBox * scl * tr1);
 				MVP = VP * Matrices.model;
-				glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-				GLint myUniformLocation = glGetUniformLocation(textureProgramID, "objectPosition");
-				glUniform3f(myUniformLocation,xpos,ypos,zpos);
-				myUniformLocation = glGetUniformLocation(textureProgramID, "playerPosition");
-				glUniform3f(myUniformLocation,playerposx, playerposy, playerposz);
-				myUniformLocation = glGetUniformLocation(textureProgramID, "playerAngle");
-				glUniform1f(myUniformLocation,playerAngle);
-				myUniformLocation = glGetUniformLocation(textureProgramID, "level");
-				glUniform1f(myUniformLocation,(float)level);
+				lit = glm::vec3(xpos,ypos,zpos);
 				for(int q=0;q<5;q++)
-					draw3DTexturedObject(block_layer[q]);
+					opaque.add(block_layer[q], MVP, lit);
 			}
 		}
 	}
-	for(int p=0;p<blocks.size();p++){
-		int i = blocks[p].first, j = blocks[p].second;
+	for(int p=0;p<game.course.blocks.size();p++){
+		int i = game.course.blocks[p].first, j = game.course.blocks[p].second;
 		float xpos = edge*(-nhor/2) + j*edge + edge/2;
 		float ypos = 10;
 		float zpos = edge*(-nvert/2) + i*edge + edge/2;
@@ -1018,23 +999,15 @@ void draw (GLFWwindow* window, int level)
 		glm::mat4 rotateBlock = glm::rotate((float)(angle * M_PI/180.0f),glm::vec3(0,1,0));
 		Matrices.model *= (translateBlock * rotateBlock * scaleBlock);
 		MVP = VP * Matrices.model;
-		glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-		GLint myUniformLocation = glGetUniformLocation(textureProgramID, "objectPosition");
-		glUniform3f(myUniformLocation,xpos,ypos,zpos);
-		myUniformLocation = glGetUniformLocation(textureProgramID, "playerPosition");
-		glUniform3f(myUniformLocation,playerposx, playerposy, playerposz);
-		myUniformLocation = glGetUniformLocation(textureProgramID, "playerAngle");
-		glUniform1f(myUniformLocation,playerAngle);
-		myUniformLocation = glGetUniformLocation(textureProgramID, "level");
-		glUniform1f(myUniformLocation,(float)level);
+		lit = glm::vec3(xpos,ypos,zpos);
 		for(int q = 0;q<5;q++)
-			draw3DTexturedObject(rotBlock[q]);
+			opaque.add(rotBlock[q], MVP, lit);
 	}
 
-	for(int p=0;p<imblocks.size();p++){
-		int i = imblocks[p].first, j = imblocks[p].second;
+	for(int p=0;p<game.course.imblocks.size();p++){
+		int i = game.course.imblocks[p].first, j = game.course.imblocks[p].second;
 		float xpos = edge*(-nhor/2) + j*edge + edge/2;
-		float ypos = impos[p].first;
+		float ypos = game.course.impos[p].first;
 		float zpos = edge*(-nvert/2) + i*edge + edge/2;
 		Matrices.model = glm::mat4(1.0f);
 		glm::mat4 translateBlock = glm::translate(glm::vec3(xpos,ypos,zpos));
@@ -1042,108 +1015,97 @@ void draw (GLFWwindow* window, int level)
 		glm::mat4 scl = glm::scale(glm::vec3(1,10,1));
 		Matrices.model *= (translateBlock *  tr1);
 		MVP = VP * Matrices.model;
-		glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-		GLint myUniformLocation = glGetUniformLocation(textureProgramID, "isPortal");
-		glUniform1f(myUniformLocation,1.0);
 		for(int q=0;q<5;q++)
-			draw3DTexturedObject(oscillator[q]);
-		if(ypos >= BLOCK_TOP_LIMIT)
-			impos[p].second = -1;
-		if(ypos <= -BLOCK_TOP_LIMIT)
-			impos[p].second = 1;
-		impos[p].first += impos[p].second;
+			opaque.add(oscillator[q], MVP, lit);
 	}
-	if(open_portal == 1){
+	if(game.open_portal == 1){
 		Matrices.model = glm::mat4(1.0f);
-		glm::vec3 portal_vec = glm::vec3(edge * (nhor/2) - edge/2,portal_pos, edge *(-nvert/2) + edge/2);
-		glm::vec3 player_vec = glm::vec3(playerposx, playerposy, playerposz);
+		glm::vec3 portal_vec = glm::vec3(edge * (nhor/2) - edge/2,game.portal_pos, edge *(-nvert/2) + edge/2);
+		glm::vec3 player_vec = glm::vec3(game.player.posx, game.player.posy, game.player.posz);
 		glm::mat4 translatePlayer = glm::translate(portal_vec);
 		glm::mat4 scalePlayer = glm::scale(glm::vec3(0.8,1,1));
 		float portal_angle = acos(dot(portal_vec - player_vec, glm::vec3(10, 10, 0))/(length(portal_vec - player_vec)*length(glm::vec3(10,10,0))) );
 		glm::mat4 rotateBlock = glm::rotate((float)(portal_angle - M_PI/2.0),glm::vec3(0,1,0));
 		Matrices.model *= (translatePlayer * rotateBlock * scalePlayer );
 		MVP = VP * Matrices.model;
-		glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-		GLint myUniformLocation = glGetUniformLocation(textureProgramID, "objectPosition");
-		glUniform3f(myUniformLocation,portal_vec.x, portal_vec.y, portal_vec.z);
-		myUniformLocation = glGetUniformLocation(textureProgramID, "playerPosition");
-		glUniform3f(myUniformLocation,playerposx, playerposy, playerposz);
-		myUniformLocation = glGetUniformLocation(textureProgramID, "playerAngle");
-		glUniform1f(myUniformLocation,playerAngle);
+		lit = glm::vec3(portal_vec.x, portal_vec.y, portal_vec.z);
 		if(level == 2)
-			draw3DTexturedObject(portal_block2);
+			blended.add(portal_block2, MVP, lit);
 		else
-			draw3DTexturedObject(portal_block);
-		portal_pos += 0.2;
-		portal_pos = min(portal_pos,10.0f);
-		if(camera_switch_state == 0 && portal_pos == 10.0f)
+			blended.add(portal_block, MVP, lit);
+		// stepGame() raises the portal; the camera only follows it
+		if(camera_switch_state == 0 && game.portal_pos == PORTAL_TOP)
 			camera_view = saved_camera, camera_switch_state = 1;
 	}
 	Matrices.model = glm::mat4(1.0f);
-	glm::mat4 translatePlayer = glm::translate(glm::vec3(playerposx, playerposy + 3.5, playerposz));
+	glm::mat4 translatePlayer = glm::translate(glm::vec3(game.player.posx, game.player.posy + 3.5, game.player.posz));
 	glm::mat4 scalePlayer = glm::scale(glm::vec3(0.4,0.5,0.3));
-	glm::mat4 roatetePlayer = glm::rotate((float)(-playerAngle*M_PI/180.0f),glm::vec3(0,1,0));
+	glm::mat4 roatetePlayer = glm::rotate((float)(-game.player.angle*M_PI/180.0f),glm::vec3(0,1,0));
 	Matrices.model *= (translatePlayer *  roatetePlayer * scalePlayer);
 	MVP = VP * Matrices.model;
-	glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-	for(int q=0;q<5;q++)draw3DTexturedObject(body_block[q]);
+	for(int q=0;q<5;q++)opaque.add(body_block[q], MVP, lit);
 
 	Matrices.model = glm::mat4(1.0f);
-	translatePlayer = glm::translate(glm::vec3(playerposx + 1*sin(playerAngle*M_PI/180.0f), playerposy + 10 , playerposz - 1*cos(playerAngle*M_PI/180.0f)));
+	translatePlayer = glm::translate(glm::vec3(game.player.posx + 1*sin(game.player.angle*M_PI/180.0f), game.player.posy + 10 , game.player.posz - 1*cos(game.player.angle*M_PI/180.0f)));
 	scalePlayer = glm::scale(glm::vec3(0.2,0.2,0.2));
-	roatetePlayer = glm::rotate((float)(-playerAngle*M_PI/180.0f),glm::vec3(0,1,0));
+	roatetePlayer = glm::rotate((float)(-game.player.angle*M_PI/180.0f),glm::vec3(0,1,0));
 	Matrices.model *= (translatePlayer *  roatetePlayer * scalePlayer);
 	MVP = VP * Matrices.model;
-	glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-	for(int q=0;q<5;q++)draw3DTexturedObject(head_block[q]);
+	for(int q=0;q<5;q++)opaque.add(head_block[q], MVP, lit);
 
 	Matrices.model = glm::mat4(1.0f);
-	translatePlayer = glm::translate(glm::vec3(playerposx + 5*cos(playerAngle*M_PI/180.0f), playerposy + 2, playerposz + 5*sin(playerAngle*M_PI/180.0f)));
+	translatePlayer = glm::translate(glm::vec3(game.player.posx + 5*cos(game.player.angle*M_PI/180.0f), game.player.posy + 2, game.player.posz + 5*sin(game.player.angle*M_PI/180.0f)));
 	scalePlayer = glm::scale(glm::vec3(0.1,0.5,0.1));
-	roatetePlayer = glm::rotate((float)(-playerAngle*M_PI/180.0f),glm::vec3(0,1,0));
+	roatetePlayer = glm::rotate((float)(-game.player.angle*M_PI/180.0f),glm::vec3(0,1,0));
 	Matrices.model *= (translatePlayer *  roatetePlayer * scalePlayer);
 	MVP = VP * Matrices.model;
-	glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-	for(int q=0;q<5;q++)draw3DTexturedObject(handl_block[q]);
+	for(int q=0;q<5;q++)opaque.add(handl_block[q], MVP, lit);
 	
 	Matrices.model = glm::mat4(1.0f);
-	translatePlayer = glm::translate(glm::vec3(playerposx - 5*cos(playerAngle*M_PI/180.0f), playerposy + 2, playerposz - 5*sin(playerAngle*M_PI/180.0f)));
+	translatePlayer = glm::translate(glm::vec3(game.player.posx - 5*cos(game.player.angle*M_PI/180.0f), game.player.posy + 2, game.player.posz - 5*sin(game.player.angle*M_PI/180.0f)));
 	scalePlayer = glm::scale(glm::vec3(0.1,0.5,0.1));
-	roatetePlayer = glm::rotate((float)(-playerAngle*M_PI/180.0f),glm::vec3(0,1,0));
+	roatetePlayer = glm::rotate((float)(-game.player.angle*M_PI/180.0f),glm::vec3(0,1,0));
 	Matrices.model *= (translatePlayer *  roatetePlayer * scalePlayer);
 	MVP = VP * Matrices.model;
-	glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-	for(int q=0;q<5;q++)draw3DTexturedObject(handl_block[q]);
+	for(int q=0;q<5;q++)opaque.add(handl_block[q], MVP, lit);
 	
 	Matrices.model = glm::mat4(1.0f);
-	translatePlayer = glm::translate(glm::vec3(playerposx + 2*cos(playerAngle*M_PI/180.0f), playerposy - 2, playerposz + 2*sin(playerAngle*M_PI/180.0f)));
+	translatePlayer = glm::translate(glm::vec3(game.player.posx + 2*cos(game.player.angle*M_PI/180.0f), game.player.posy - 2, game.player.posz + 2*sin(game.player.angle*M_PI/180.0f)));
 	scalePlayer = glm::scale(glm::vec3(0.1,0.5,0.1));
-	roatetePlayer = glm::rotate((float)(-playerAngle*M_PI/180.0f),glm::vec3(0,1,0));
+	roatetePlayer = glm::rotate((float)(-game.player.angle*M_PI/180.0f),glm::vec3(0,1,0));
 	Matrices.model *= (translatePlayer *  roatetePlayer * scalePlayer);
 	MVP = VP * Matrices.model;
-	glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-	for(int q=0;q<5;q++)draw3DTexturedObject(handl_block[q]);
+	for(int q=0;q<5;q++)opaque.add(handl_block[q], MVP, lit);
 	
 	Matrices.model = glm::mat4(1.0f);
-	translatePlayer = glm::translate(glm::vec3(playerposx - 2*cos(playerAngle*M_PI/180.0f), playerposy - 2, playerposz - 2*sin(playerAngle*M_PI/180.0f)));
+	translatePlayer = glm::translate(glm::vec3(game.player.posx - 2*cos(game.player.angle*M_PI/180.0f), game.player.posy - 2, game.player.posz - 2*sin(game.player.angle*M_PI/180.0f)));
 	scalePlayer = glm::scale(glm::vec3(0.1,0.5,0.1));
-	roatetePlayer = glm::rotate((float)(-playerAngle*M_PI/180.0f),glm::vec3(0,1,0));
+	roatetePlayer = glm::rotate((float)(-game.player.angle*M_PI/180.0f),glm::vec3(0,1,0));
 	Matrices.model *= (translatePlayer *  roatetePlayer * scalePlayer);
 	MVP = VP * Matrices.model;
-	glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-	for(int q=0;q<5;q++)draw3DTexturedObject(handl_block[q]);
+	for(int q=0;q<5;q++)opaque.add(handl_block[q], MVP, lit);
 	
 	Matrices.model = glm::mat4(1.0f);
-	translatePlayer = glm::translate(glm::vec3(playerposx + 3.1*sin(playerAngle*M_PI/180.0f), playerposy +10  , playerposz - 3.1*cos(playerAngle*M_PI/180.0f)));
+	translatePlayer = glm::translate(glm::vec3(game.player.posx + 3.1*sin(game.player.angle*M_PI/180.0f), game.player.posy +10  , game.player.posz - 3.1*cos(game.player.angle*M_PI/180.0f)));
 	scalePlayer = glm::scale(glm::vec3(0.18,0.18,1));
-	roatetePlayer = glm::rotate((float)(-playerAngle*M_PI/180.0f),glm::vec3(0,1,0));
+	roatetePlayer = glm::rotate((float)(-game.player.angle*M_PI/180.0f),glm::vec3(0,1,0));
 	Matrices.model *= (translatePlayer *  roatetePlayer * scalePlayer);
 	MVP = VP * Matrices.model;
-	glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-	draw3DTexturedObject(eye_layer);
+	blended.add(eye_layer, MVP, lit);
 	
-	for(int p=0;p<treasure.size();p++){
-		int i = treasure[p].first, j = treasure[p].second;
+	for(int p=0;p<crowd.size();p++){
+		const Agent &agent = crowd[p];
+		Matrices.model = glm::mat4(1.0f);
+		translatePlayer = glm::translate(glm::vec3(agent.posx, agent.posy + 3.5, agent.posz));
+		scalePlayer = glm::scale(glm::vec3(0.4,0.5,0.3));
+		roatetePlayer = glm::rotate((float)(-agent.angle*M_PI/180.0f),glm::vec3(0,1,0));
+		Matrices.model *= (translatePlayer *  roatetePlayer * scalePlayer);
+		MVP = VP * Matrices.model;
+		for(int q=0;q<5;q++)opaque.add(body_block[q], MVP, lit);
+	}
+
+	for(int p=0;p<game.treasure.size();p++){
+		int i = game.treasure[p].first, j = game.treasure[p].second;
 		float xpos = edge*(-nhor/2) + j*edge + edge/2;
 		float ypos = 5;
 		float zpos = edge*(-nvert/2) + i*edge + edge/2;
@@ -1153,10 +1115,20 @@ void draw (GLFWwindow* window, int level)
 		glm::mat4 scaleBlock = glm::scale(glm::vec3(0.5,1,0.5));
 		Matrices.model *= (translateBlock * rotateBlock * scaleBlock);
 		MVP = VP * Matrices.model;
-		glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-		for(int q=0;q<5;q++)draw3DTexturedObject(treasure_block[q]);
+		for(int q=0;q<5;q++)opaque.add(treasure_block[q], MVP, lit);
 	}
-	glUseProgram (programID);
+	if(overdraw)
+		countOverdraw(textureProgram, OVERDRAW_CODE, 0);
+	if(drawOrder != DRAW_CODE)
+		opaque.sortFrontToBack();
+	if(overdraw)
+		countOverdraw(textureProgram, OVERDRAW_DRAWN, drawOrder == DRAW_PREPASS);
+	drawScene(textureProgram, drawOrder == DRAW_PREPASS);
+	// The HUD below is drawn at full resolution over the stretched scene
+	if(renderScale.active())
+		renderScale.end();
+
+	glUseProgram (colourProgram.id);
 	// Load identity to model matrix
 	Matrices.model = glm::mat4(1.0f);
 
@@ -1195,7 +1167,7 @@ void draw (GLFWwindow* window, int level)
 
 
 	// Use font Shaders for next part of code
-	glUseProgram(fontProgramID);
+	glUseProgram(fontProgram.id);
 	Matrices.view = glm::lookAt(glm::vec3(0,0,3), glm::vec3(0,0,0), glm::vec3(0,1,0)); // Fixed camera for 2D (ortho) in XY plane
 
 	// Transform the text
@@ -1215,14 +1187,49 @@ void draw (GLFWwindow* window, int level)
 	str[8]='\0';
 	// Render font
 	GL3Font.font->Render(str);
+
+	// Shader build errors down the left edge, while the old program keeps drawing
+	if(shaderWatcher && !shaderWatcher->errors().empty()){
+		glm::vec3 errorColor = glm::vec3(0.8f, 0.1f, 0.1f);
+		glUniform3fv(GL3Font.fontColorID, 1, &errorColor[0]);
+		const string &log = shaderWatcher->errors();
+		size_t start = 0;
+		for(int line=0; line<30 && start<log.size(); line++){
+			size_t end = log.find('\n', start);
+			if(end == string::npos)
+				end = log.size();
+			Matrices.model = glm::translate(glm::vec3(-590, -285 + 18*line, 0)) * glm::scale(glm::vec3(14,14,14)) * rotateText;
+			MVP = Matrices.projection * Matrices.view * Matrices.model;
+			glUniformMatrix4fv(GL3Font.fontMatrixID, 1, GL_FALSE, &MVP[0][0]);
+			GL3Font.font->Render(log.substr(start, end - start).c_str());
+			start = end + 1;
+		}
+	}
 	font_state = 0;
 	reshapeWindow(window,1200,600);
 }
 
+/* Uniform and attribute locations held outside the programs, looked up again
+   whenever the shader watcher replaces a program */
+void resolveLocations ()
+{
+	// Get a handle for our "MVP" uniforms
+	Matrices.MatrixID = colourProgram.uniform("MVP");
+
+	GLint fontVertexCoordAttrib, fontVertexNormalAttrib, fontVertexOffsetUniform;
+	fontVertexCoordAttrib = glGetAttribLocation(fontProgram.id, "vertexPosition");
+	fontVertexNormalAttrib = glGetAttribLocation(fontProgram.id, "vertexNormal");
+	fontVertexOffsetUniform = fontProgram.uniform("pen");
+	GL3Font.fontMatrixID = fontProgram.uniform("MVP");
+	GL3Font.fontColorID = fontProgram.uniform("fontColor");
+	GL3Font.font->ShaderLocations(fontVertexCoordAttrib, fontVertexNormalAttrib, fontVertexOffsetUniform);
+}
+
 /* Initialise glfw window, I/O callbacks and the renderer to use */
 /* Nothing to Edit here */
 GLFWwindow* initGLFW (int width, int height)
 {
+	TRACE_SCOPE("initGLFW");
 	GLFWwindow* window; // window desciptor/handle
 
 	glfwSetErrorCallback(error_callback);
@@ -1235,7 +1242,10 @@ GLFWwindow* initGLFW (int width, int height)
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
-	window = glfwCreateWindow(width, height, "Adventura", NULL, NULL);
+	{
+		TRACE_SCOPE("glfwCreateWindow");
+		window = glfwCreateWindow(width, height, "Adventura", NULL, NULL);
+	}
 
 	if (!window) {
 		glfwTerminate();
@@ -1243,8 +1253,11 @@ GLFWwindow* initGLFW (int width, int height)
 	}
 
 	glfwMakeContextCurrent(window);
-	gladLoadGLLoader((GLADloadproc) glfwGetProcAddress);
-	glfwSwapInterval( 1 );
+	{
+		TRACE_SCOPE("gladLoadGLLoader");
+		gladLoadGLLoader((GLADloadproc) glfwGetProcAddress);
+	}
+	glfwSwapInterval( pacer.swapInterval() );
 
 	/* --- register callbacks with GLFW --- */
 
@@ -1272,6 +1285,7 @@ GLFWwindow* initGLFW (int width, int height)
 /* Add all the models to be created here */
 void initGL (GLFWwindow* window, int width, int height)
 {
+	TRACE_SCOPE("initGL");
 	// Load Textures
 	// Enable Texture0 as current texture memory
 	glActiveTexture(GL_TEXTURE0);
@@ -1279,51 +1293,58 @@ void initGL (GLFWwindow* window, int width, int height)
 	// load an image file directly as a new OpenGL texture
 	// GLuint texID = SOIL_load_OGL_texture ("beach.png", SOIL_LOAD_AUTO, SOIL_CREATE_NEW_ID, SOIL_FLAG_TEXTURE_REPEATS); // Buggy for OpenGL3
 	//GLuint textureID = createTexture("background.png");
-	GLuint treasureT, eye, body, handl,textureID[7], building_top, rot_block, rot_block_top, oscillate_block, floor_block_side, oscillate_block_side, portal, portal2, head;
-	textureID[0] = createTexture("images/front.png");
-	textureID[1] = createTexture("images/top.png");
-	textureID[2] = createTexture("images/left.png");
-	textureID[3] = createTexture("images/right.png");
-	textureID[4] = createTexture("images/back.png");
-	textureID[5] = createTexture("images/bottom.png");
-	building_top = createTexture("images/toptexture.png");
-	rot_block = createTexture("images/rotatingblock.png");
-	rot_block_top = createTexture("images/rotBlockTop.png");
-	oscillate_block = createTexture("images/oscillate.png");
-	floor_block_side = createTexture("images/block_layer_side.png");
-	oscillate_block_side = createTexture("images/oscSide.png");
-	portal = createTexture("images/portal.png");
-	portal2 = createTexture("images/portal2.png");
-	head = createTexture("images/head.png");
-	body = createTexture("images/body.png");
-	handl = createTexture("images/handl.png");
-	eye = createTexture("images/eye.png");
-	treasureT = createTexture("images/treasure.png");
-
-	// check for an error during the load process
-		if(head == 0)
-			cout << "SOIL loading error: '" << SOIL_last_result() << "'" << endl;
-
-	// Create and compile our GLSL program from the texture shaders
-	textureProgramID = LoadShaders( "TextureRender.vert", "TextureRender.frag" );
-	// Get a handle for our "MVP" uniform
-	Matrices.TexMatrixID = glGetUniformLocation(textureProgramID, "MVP");
+	// Nothing is loaded here; each level prefetches what it draws (levelTextures)
+	int textureID[6];
+	const char* sky[6] = { "images/front.png", "images/top.png", "images/left.png", "images/right.png", "images/back.png", "images/bottom.png" };
+	for(int f=0;f<6;f++)
+		textureID[f] = assets->declare(sky[f]);
+	int building_top = assets->declare("images/toptexture.png");
+	int rot_block = assets->declare("images/rotatingblock.png");
+	int rot_block_top = assets->declare("images/rotBlockTop.png");
+	int oscillate_block = assets->declare("images/oscillate.png");
+	int floor_block_side = assets->declare("images/block_layer_side.png");
+	int oscillate_block_side = assets->declare("images/oscSide.png");
+	// Character parts and pickups, packed into one atlas by tools/atlaspack if it was run
+	const char* packed[] = { "images/portal.png", "images/portal2.png", "images/head.png", "images/body.png",
+		"images/handl.png", "images/eye.png", "images/treasure.png" };
+	TextureAtlas atlas;
+	AssetSpan span;
+	int use_atlas = atlas.load(ATLAS_TABLE) && (findAsset(ATLAS_IMAGE, span) || !access(ATLAS_IMAGE, R_OK));
+	for(int p=0;p<sizeof(packed)/sizeof(packed[0]);p++)
+		if(use_atlas && !atlas.find(packed[p]))
+			use_atlas = 0;
+	int atlasT = -1;
+	if(use_atlas){
+		atlasT = assets->declare(ATLAS_IMAGE);
+		for(int p=0;p<sizeof(packed)/sizeof(packed[0]);p++)
+			assets->alias(packed[p], atlasT);
+	}
+	else
+		atlas.clear();
+	int portal = assets->declare("images/portal.png"), portal2 = assets->declare("images/portal2.png");
+	int head = assets->declare("images/head.png"), body = assets->declare("images/body.png");
+	int handl = assets->declare("images/handl.png"), eye = assets->declare("images/eye.png");
+	int treasureT = assets->declare("images/treasure.png");
+
+	// Create and compile our GLSL programs from the texture shaders
+	for(int l=0;l<LIGHTING_MODES;l++)
+		texturePrograms[l].load();
 
 
 	/* Objects should be created before any other gl function and shaders */
 	// Create the models
 	// Generate the VAO, VBOs, vertices data & copy into the array buffer
 	createBackground (textureID);
-	createRotatingBlock (rot_block, rot_block_top, oscillate_block, building_top, floor_block_side, oscillate_block_side, head, body, handl, treasureT);
-	createportal(portal, portal2);
+	createRotatingBlock (rot_block, rot_block_top, oscillate_block, building_top, floor_block_side, oscillate_block_side,
+			atlas.image("images/head.png", atlasT, head), atlas.image("images/body.png", atlasT, body),
+			atlas.image("images/handl.png", atlasT, handl), atlas.image("images/treasure.png", atlasT, treasureT));
+	createportal(atlas.image("images/portal.png", atlasT, portal), atlas.image("images/portal2.png", atlasT, portal2));
 	createLifebar ();
-	createEye(eye);
+	createEye(atlas.image("images/eye.png", atlasT, eye));
 	//createCatapult2();
 
 	// Create and compile our GLSL program from the shaders
-	programID = LoadShaders( "Sample_GL.vert", "Sample_GL.frag" );
-	// Get a handle for our "MVP" uniform
-	Matrices.MatrixID = glGetUniformLocation(programID, "MVP");
+	colourProgram.load();
 
 
 	reshapeWindow (window, width, height);
@@ -1341,7 +1362,12 @@ void initGL (GLFWwindow* window, int width, int height)
 	// Initialise FTGL stuff
 	//const char* fontfile = "UpsideDown.ttf";
 	const char* fontfile = "arial.ttf";
-	GL3Font.font = new FTExtrudeFont(fontfile); // 3D extrude style rendering
+	TRACE_SCOPE("font", fontfile);
+	AssetSpan fontdata;
+	if(findAsset(fontfile, fontdata))
+		GL3Font.font = new FTExtrudeFont(fontdata.data, fontdata.size); // FreeType reads it from the pack mapping
+	else
+		GL3Font.font = new FTExtrudeFont(fontfile); // 3D extrude style rendering
 
 	if(GL3Font.font->Error())
 	{
@@ -1351,15 +1377,8 @@ void initGL (GLFWwindow* window, int width, int height)
 	}
 
 	// Create and compile our GLSL program from the font shaders
-	fontProgramID = LoadShaders( "fontrender.vert", "fontrender.frag" );
-	GLint fontVertexCoordAttrib, fontVertexNormalAttrib, fontVertexOffsetUniform;
-	fontVertexCoordAttrib = glGetAttribLocation(fontProgramID, "vertexPosition");
-	fontVertexNormalAttrib = glGetAttribLocation(fontProgramID, "vertexNormal");
-	fontVertexOffsetUniform = glGetUniformLocation(fontProgramID, "pen");
-	GL3Font.fontMatrixID = glGetUniformLocation(fontProgramID, "MVP");
-	GL3Font.fontColorID = glGetUniformLocation(fontProgramID, "fontColor");
-
-	GL3Font.font->ShaderLocations(fontVertexCoordAttrib, fontVertexNormalAttrib, fontVertexOffsetUniform);
+	fontProgram.load();
+	resolveLocations();
 	GL3Font.font->FaceSize(1);
 	GL3Font.font->Depth(0);
 	GL3Font.font->Outset(0, 0);
@@ -1370,351 +1389,221 @@ void initGL (GLFWwindow* window, int width, int height)
 	cout << "VERSION: " << glGetString(GL_VERSION) << endl;
 	cout << "GLSL: " << glGetString(GL_SHADING_LANGUAGE_VERSION) << endl;
 }
-int checkPlayerOnBlock(){
-	for(int p = 0;p<blocks.size();p++){
-		int i = blocks[p].first, j = blocks[p].second;
-		float xpos = edge*(-nhor/2) + j*edge + edge/2;
-		float ypos = 10;
-		float zpos = edge*(-nvert/2) + i*edge + edge/2;
-		if(playerposx + edge/4 > xpos - edge/2 &&
-				playerposx - edge/4 < xpos + edge/2 &&
-				playerposz + edge/4 > zpos - edge/2 &&
-				playerposz - edge/4 < zpos + edge/2 &&
-				playerposy - edge/2 <= ypos + edge/2 &&
-				playerposy - edge/2 >= ypos + edge/4
-		  ){
-			return p+1;
-		}
-	}
-	for(int p = 0;p<imblocks.size();p++){
-		int i = imblocks[p].first, j = imblocks[p].second;
-		float xpos = edge*(-nhor/2) + j*edge + edge/2;
-		float ypos = impos[p].first - edge / 2;
-		float zpos = edge*(-nvert/2) + i*edge + edge/2;
-		if(playerposx + edge/4 > xpos - edge/2 &&
-				playerposx - edge/4 < xpos + edge/2 &&
-				playerposz + edge/4 > zpos - edge/2 &&
-				playerposz - edge/4 < zpos + edge/2 
-		  ){
-			return 100 + p+1;
-		}
-	}
-	return 0;
-}
-void checkPlayerOnImblock(){}
-void checkFall(){
-	if(playerposx < edge *(-nhor/2) - edge/4 || playerposx > edge*(-nhor/2) +(nhor)*edge + edge/4 ||
-			playerposz > edge*(-nvert/2) + nvert * edge + edge/4 || playerposz < edge *(-nvert/2) - edge/4){
-		playerposy--;
-		return;
-	}
-	for(int p=0;p<holes.size();p++){
-		int i = holes[p].first;
-		int j = holes[p].second;
-		if(playerposz >= edge*(-nhor/2)+i*edge + edge/4 && playerposz <= edge*(-nhor/2) + (i+1)*edge - edge/4 &&
-				playerposx >= edge*(-nvert/2) + j*edge + edge/4 && playerposx <= edge*(-nvert/2) + (j+1)*edge -edge/4){
-			playerposy--;
-			return;
-		}
-	}
-	int playerOnBlock = checkPlayerOnBlock();
-	if(playerOnBlock){
-		falling = 0;
-		speedy = 0;
-		if(playerOnBlock<=100){
-			playerposy = 10 + edge;
-			return;
-		}
-		else if((playerposy - edge/2 >= impos[playerOnBlock - 100 -1].first || playerposy + edge/2 <= impos[playerOnBlock - 100 - 1].first - edge)){
-			int i = imblocks[playerOnBlock - 100 - 1].first, j = imblocks[playerOnBlock - 100 - 1].second;
-			float xpos = edge*(-nhor/2) + j*edge + edge/2;
-			float zpos = edge*(-nvert/2) + i*edge + edge/2;
-			if(playerposx - edge/4 > xpos - edge/2 &&
-					playerposx + edge/4 < xpos + edge/2 &&
-					playerposz - edge/4 > zpos - edge/2 &&
-					playerposz + edge/4 < zpos + edge/2)
-			playerposy--;
-			return;
-		}
-		else{
-			playerposy = impos[playerOnBlock - 100 - 1].first + edge/2;
-			return;
-		}
+void movePlayer(){
+	stepGame(game);
+	if(game.events & GAME_TREASURE)
+		audio->play(SOUND_TREASURE);
+	if(game.events & GAME_PORTAL_OPEN)
+		audio->play(SOUND_PORTAL_OPEN);
+	if(game.events & GAME_PORTAL_ENTERED)
+		audio->play(SOUND_PORTAL_ENTER);
+	if(game.events & GAME_TREASURE){
+		saved_camera = camera_view;
+		camera_view = PORTAL_VIEW;
 	}
-	else if(!playerOnGround())
-		playerposy--;
 }
-void turnPlayer(){
-	if(turn_right)
-		playerAngle += 1;
-	if(turn_left)
-		playerAngle -= 1;
+
+
+/* music<level>.mp3 if the level has a track of its own, game.mp3 otherwise */
+static string levelMusic (int level)
+{
+	char track[32];
+	sprintf(track, "music%d.mp3", level);
+	AssetSpan span;
+	if(findAsset(track, span) || !access(track, R_OK))
+		return track;
+	return "game.mp3";
 }
-void jumpPlayer(){
-	if(jump == 1){
-		playerposy += speedy;
-		int playerOnBlock = checkPlayerOnBlock();
-		if(playerOnBlock)
-			if(playerOnBlock<=100 ||
-					(playerOnBlock > 100 && playerposy - edge/2 <= impos[playerOnBlock - 100 -1].first)|| 
-					playerOnGround()){
-				speedy = 0;
-				jump = 0;
-			}
-			else
-				speedy -= 0.5;
-		else
-			if(playerOnGround())
-				speedy = 0,jump = 0;
-			else
-				speedy -= 0.5;
+
+/* Blocks and the portal are heard up to this many cells away */
+#define AUDIBLE_CELLS 3
+
+/* First emitter of the oscillating blocks, in course order, and the portal's */
+int oscillatorEmitter, portalEmitter;
+
+/* A hum on every rotating block, a whir on every oscillating one and a drone
+   on the portal, silent until it opens */
+static void levelEmitters (const GameInstance &game)
+{
+	const Course &course = game.course;
+	EmitterField &field = audio->emitters();
+	field.clear();
+	field.setGrid(course.edge*(-course.nhor/2), course.edge*(-course.nvert/2), course.edge, (int)course.nhor, (int)course.nvert);
+	field.setRadius(AUDIBLE_CELLS * course.edge);
+	for(int p=0;p<course.blocks.size();p++)
+		field.add(SOUND_HUM, 1, course.cellX(course.blocks[p].second), 10, course.cellZ(course.blocks[p].first));
+	oscillatorEmitter = -1;
+	for(int p=0;p<course.imblocks.size();p++){
+		int id = field.add(SOUND_WHIR, 1, course.cellX(course.imblocks[p].second), course.impos[p].first, course.cellZ(course.imblocks[p].first));
+		if(!p)
+			oscillatorEmitter = id;
 	}
+	portalEmitter = field.add(SOUND_DRONE, 0, course.edge*(course.nhor/2) - course.edge/2, game.portal_pos, course.edge*(-course.nvert/2) + course.edge/2);
 }
-int checkCollision(float xpos, float ypos, float zpos, int direction){
-		switch(direction){
-			case 1:
-				if(playerposz - cos(playerAngle*M_PI/180.0f) - edge/4 < zpos + edge/2 &&
-						playerposz - cos(playerAngle*M_PI/180.0f) + edge/4 > zpos - edge/2 &&
-						playerposx + edge/4 > xpos - edge/2 &&
-						playerposx - edge/4 < xpos + edge/2 &&
-						playerposy - edge/4 < ypos + edge/2 &&
-						playerposy + edge/4 > ypos - edge/2
-				  )
-					return 1;
-				break;
-			case 2:
-				if(playerposz + cos(playerAngle*M_PI/180.0f) + edge/4 > zpos - edge/2 &&
-						playerposz + cos(playerAngle*M_PI/180.0f) - edge/4 < zpos + edge/2 &&
-						playerposx + edge/4 > xpos - edge/2 &&
-						playerposx - edge/4 < xpos + edge/2 &&
-						playerposy - edge/4 < ypos + edge/2 &&
-						playerposy + edge/4 > ypos - edge/2
-				  )
-					return 1;
-				break;
-			case 3:
-				if(playerposx + cos(playerAngle*M_PI/180.0f) + edge/4 > xpos - edge/2 &&
-						playerposx + cos(playerAngle*M_PI/180.0f) - edge/4 < xpos + edge/2 &&
-						playerposz - edge/4 < zpos + edge/2 &&
-						playerposz + edge/4 > zpos - edge/2 &&
-						playerposy - edge/4 < ypos + edge/2 &&
-						playerposy + edge/4 > ypos - edge/2
-				  )
-					return 1;
-				break;
-			case 4:
-				if(playerposx - cos(playerAngle*M_PI/180.0f) - edge/4 < xpos + edge/2 &&
-						playerposx - cos(playerAngle*M_PI/180.0f) + edge/4 > xpos - edge/2 &&
-						playerposz - edge/4 < zpos + edge/2 &&
-						playerposz + edge/4 > zpos - edge/2 &&
-						playerposy - edge/4 < ypos + edge/2 &&
-						playerposy + edge/4 > ypos - edge/2
-				  )
-					return 1;
-				break;
 
-		}
-		return 0;
-}
-int collideBlocks(int direction){
-	for(int p = 0;p<blocks.size();p++){
-		int i = blocks[p].first;
-		int j = blocks[p].second;
-		float xpos = edge*(-nhor/2) + j*edge + edge/2;
-		float ypos = 10;
-		float zpos = edge*(-nvert/2) + i*edge + edge/2;
-		if(checkCollision(xpos, ypos, zpos, direction) == 1)
-			return 1;
-	}
-	for(int p = 0;p<imblocks.size();p++){
-		int i = imblocks[p].first;
-		int j = imblocks[p].second;
-		float xpos = edge*(-nhor/2) + j*edge + edge/2;
-		float ypos = impos[p].first - edge/2;
-		float zpos = edge*(-nvert/2) + i*edge + edge/2;
-		if(impos[p].first > 0 && checkCollision(xpos, ypos, zpos, direction) == 1 )
-			return 1;
-	}
-	int playerOnBlock = checkPlayerOnBlock();
-	return 0;
+/* Once a frame: move the sources that move, then hand them and the player's ears to the audio thread */
+static void updateEmitters (const GameInstance &game)
+{
+	const Course &course = game.course;
+	EmitterField &field = audio->emitters();
+	for(int p=0;p<course.imblocks.size() && oscillatorEmitter >= 0;p++)
+		field.move(oscillatorEmitter + p, course.cellX(course.imblocks[p].second), course.impos[p].first, course.cellZ(course.imblocks[p].first));
+	field.move(portalEmitter, course.edge*(course.nhor/2) - course.edge/2, game.portal_pos, course.edge*(-course.nvert/2) + course.edge/2);
+	field.setGain(portalEmitter, game.open_portal ? 1 : 0);
+	Listener ears = { game.player.posx, game.player.posy, game.player.posz, game.player.angle };
+	field.setListener(ears);
+	field.publish();
 }
-void collectTreasure(){
-	for(int p = 0;p<treasure.size();p++){
-		int i = treasure[p].first;
-		int j = treasure[p].second;
-		float xpos = edge*(-nhor/2) + j*edge + edge/2;
-		float ypos = 5;
-		float zpos = edge*(-nvert/2) + i*edge + edge/2;
-		if(playerposx + edge/4 >= xpos - edge/2 && playerposx - edge/4 <= xpos + edge/2 &&
-				playerposz + edge/4 >= zpos - edge/2 && playerposz - edge/4 <= zpos + edge/2 &&
-				playerposy + edge/2 >= ypos - edge/2 && playerposy - edge/2 <= ypos + edge/2){
-			treasure.erase(treasure.begin() + p);
-			saved_camera = camera_view;
-			camera_view = PORTAL_VIEW;
-			return;
-		}
+
+/* Textures level draws: sky, floor and player always, the rest only if its
+   course has rotating blocks, oscillators or treasure; level 2 has its own portal */
+static void levelTextures (const GameInstance &game, vector<int> &ids)
+{
+	const char* always[] = { "images/front.png", "images/top.png", "images/left.png", "images/right.png",
+		"images/back.png", "images/bottom.png", "images/toptexture.png", "images/block_layer_side.png",
+		"images/head.png", "images/body.png", "images/handl.png", "images/eye.png" };
+	ids.clear();
+	for(int a=0;a<sizeof(always)/sizeof(always[0]);a++)
+		ids.push_back(assets->declare(always[a]));
+	if(game.course.blocks.size()){
+		ids.push_back(assets->declare("images/rotatingblock.png"));
+		ids.push_back(assets->declare("images/rotBlockTop.png"));
 	}
-}
-void movePlayer(){
-	turnPlayer();
-	if(jump == 0)checkFall();
-	jumpPlayer();
-	int playerOnBlock = checkPlayerOnBlock();
-	if(playerOnBlock && playerOnBlock <= 100){
-		playerAngle--;
+	if(game.course.imblocks.size()){
+		ids.push_back(assets->declare("images/oscillate.png"));
+		ids.push_back(assets->declare("images/oscSide.png"));
 	}
-	checkPlayerOnImblock();
-	int front = 1, back = 2, right = 3, left =4;
-	collectTreasure();
-	if(!treasure.size())
-		open_portal = 1;
-	if(movefront == 1 && !falling && !collideBlocks(1))
-		playerposz-=cos(playerAngle*M_PI/180.0f), playerposx+=sin(playerAngle*M_PI/180.0f);
-	if(moveleft == 1 && !falling && !collideBlocks(4))
-		playerposx-=cos(playerAngle*M_PI/180.0f), playerposz-=sin(playerAngle*M_PI/180.0f);
-	if(moveright == 1 && !falling && !collideBlocks(3))
-		playerposx+=cos(playerAngle*M_PI/180.0f), playerposz+=sin(playerAngle*M_PI/180.0f);
-	if(moveback == 1 && !falling && !collideBlocks(2))
-		playerposz+=cos(playerAngle*M_PI/180.0f), playerposx-=sin(playerAngle*M_PI/180.0f);
-}
-int portal_reached(){
-	if(!open_portal)
-		return 0;
-	float xpos = edge * (nhor/2) - edge/2;
-	float ypos = portal_pos;
-	float zpos = edge *(-nvert/2) + edge/2;
-	if(playerposx + edge/4 >= xpos - edge/2 && playerposx - edge/4 <= xpos + edge/2 &&
-			playerposz + edge/4 >= zpos - edge/2 && playerposz - edge/4 <= zpos + edge/2 &&
-			playerposy + edge/2 >= ypos - edge/2 && playerposy - edge/2 <= ypos + edge/2)
-		return 1;
-	return 0;
+	if(game.course.treasure.size())
+		ids.push_back(assets->declare("images/treasure.png"));
+	ids.push_back(assets->declare(game.level == 2 ? "images/portal2.png" : "images/portal.png"));
 }
 
+static void reportResidency ()
+{
+	resources.report(stdout);
+	if(quality.budget())
+		printf("Texture budget: %.1f of %.1f MB\n", resources.residentBytes(RESOURCE_TEXTURE) / (1024.0 * 1024.0),
+				quality.budget() / (1024.0 * 1024.0));
+}
 
 int main (int argc, char** argv)
 {
+	// First, so every phase after it and every worker thread is recorded
+	traceStart(getenv("ADVENTURA_TRACE"));
+
 	int width = 1200;
 	int height = 600;
+	int crowd_size = 0;
+
+	// Before any thread starts, so they all see the mapping
+	const char *pack = getenv("ADVENTURA_PACK");
+	if(!openAssets(pack ? pack : ASSET_PACK) && pack)
+		cout << "Could not open asset pack " << pack << ", using loose files" << endl;
+
+	const char *tier = getenv("ADVENTURA_QUALITY");
+	if(tier && !quality.configure(tier))
+		cout << "Unknown ADVENTURA_QUALITY '" << tier << "', using high" << endl;
+	const char *budget = getenv("ADVENTURA_TEXTURE_BUDGET");
+	if(budget)
+		quality.setBudget((size_t)(atof(budget) * 1024 * 1024));
+
+	const char *pacing = getenv("ADVENTURA_PACING");
+	if(pacing && !pacer.configure(pacing))
+		cout << "Unknown ADVENTURA_PACING '" << pacing << "', using vsync" << endl;
+
+	const char *order = getenv("ADVENTURA_DRAW_ORDER");
+	if(order){
+		int parsed = parseDrawOrder(order);
+		if(parsed < 0)
+			cout << "Unknown ADVENTURA_DRAW_ORDER '" << order << "', using sorted" << endl;
+		else
+			drawOrder = parsed;
+	}
+	const char *counting = getenv("ADVENTURA_OVERDRAW");
+	if(counting && atoi(counting))
+		overdraw = new OverdrawCounter();
+	const char *spotlight = getenv("ADVENTURA_SPOTLIGHT");
+	if(spotlight){
+		if(!strcmp(spotlight, "smooth"))
+			smoothSpotlight = 1;
+		else if(strcmp(spotlight, "hard"))
+			cout << "Unknown ADVENTURA_SPOTLIGHT '" << spotlight << "', using hard" << endl;
+	}
+	const char *scale = getenv("ADVENTURA_RENDER_SCALE");
+	if(scale && !renderScale.configure(scale))
+		cout << "Unknown ADVENTURA_RENDER_SCALE '" << scale << "', using 1" << endl;
+
+	for(int i=1;i<argc;i++)
+		if(!strcmp(argv[i], "--agents") && i+1 < argc)
+			crowd_size = atoi(argv[++i]);
+	jobs = new JobSystem();
+	{
+		TRACE_SCOPE("openTextureCache");
+		textureCache.open(TEXTURE_CACHE);
+	}
+	assets = new AssetSet(resources, *jobs);
+	assets->configure(&textureCache, &quality);
 
 	GLFWwindow* window = initGLFW(width, height);
 
 	initGL (window, width, height);
 
-	double last_update_time = glfwGetTime(), current_time;
-
-
-	pid = fork();
-	if(pid==0){
-		mpg123_handle *mh;
-		unsigned char *buffer;
-		size_t buffer_size;
-		size_t done;
-		int err;
-
-		int driver;
-		ao_device *dev;
-
-		ao_sample_format format;
-		int channels, encoding;
-		long rate;
-
-
-		/* initializations */
-		ao_initialize();
-		driver = ao_default_driver_id();
-		mpg123_init();
-		mh = mpg123_new(NULL, &err);
-		buffer_size = mpg123_outblock(mh);
-		buffer = (unsigned char*) malloc(buffer_size * sizeof(unsigned char));
-
-		/* open the file and get the decoding format */
-		mpg123_open(mh, "game.mp3");
-		mpg123_getformat(mh, &rate, &channels, &encoding);
-
-		/* set the output format and open the output device */
-		format.bits = mpg123_encsize(encoding) * BITS;
-		format.rate = rate;
-		format.channels = channels;
-		format.byte_format = AO_FMT_NATIVE;
-		format.matrix = 0;
-		dev = ao_open_live(driver, &format, NULL);
-
-		/* decode and play */
-		char *p =(char *)buffer;
-		while (mpg123_read(mh, buffer, buffer_size, &done) == MPG123_OK)
-			ao_play(dev, p, done);
-
-
-		/* clean up */
-		free(buffer);
-		ao_close(dev);
-		mpg123_close(mh);
-		mpg123_delete(mh);
-		mpg123_exit();
-		ao_shutdown();
-		_exit(0);
+
+	// Music and effects play on threads of this process; without a device the game stays silent
+	audio = new AudioSystem();
+	const char *sink = getenv("ADVENTURA_AUDIO");
+	if(sink && !audio->configure(sink))
+		cout << "Unknown ADVENTURA_AUDIO '" << sink << "', using ao" << endl;
+	if(!audio->start(levelMusic(1).c_str()))
+		cout << "Unable to open audio output, playing silently" << endl;
+
+	const char *watch = getenv("ADVENTURA_WATCH_SHADERS");
+	if(watch && atoi(watch)){
+		static ShaderProgram *watched[] = { &texturePrograms[0], &texturePrograms[1], &texturePrograms[2], &texturePrograms[3], &colourProgram, &fontProgram };
+		shaderWatcher = new ShaderWatcher();
+		if(!shaderWatcher->start(window, watched, 6)){
+			cout << "Unable to watch shader sources" << endl;
+			delete shaderWatcher;
+			shaderWatcher = NULL;
+		}
 	}
 
 	int level = 1;
 	while(1){
-		string line;
-		char filename[100];
-		sprintf(filename,"%d.txt",level);
-		ifstream levelfile(filename);
-		if(levelfile.is_open()){
-			int i=0;
-			while(getline(levelfile, line)){
-				cout<<line<<endl;
-				for(int j=0;line[j]!='\0';j++)
-					gamemat[i][j]=line[j];
-				i++;
-			}
-			levelfile.close();
-		}
-		else
+		if(!startLevel(game, level))
 			cout<<"Unable to open file";
-
-		for(int i= 0;i<nhor;i++)
-			for(int j=0;j<nvert;j++){
-				switch(gamemat[i][j]){
-					case 'X':
-						holes.push_back(make_pair(i,j));
-						break;
-					case 'B':
-						blocks.push_back(make_pair(i,j));
-						break;
-					case 'T':
-						treasure.push_back(make_pair(i,j));
-				}
-				if(gamemat[i][j]>='0' && gamemat[i][j]<='9')
-					imblocks.push_back(make_pair(i,j)), impos.push_back(make_pair((gamemat[i][j] - '0') * 20,1));
-			}
-
+		if(crowd_size)
+			spawnAgents(game.course, crowd, crowd_size, level);
+		// Free what only the last level drew, so its textures don't count
+		// against the budget, then load what this one draws
+		vector<int> needed;
+		{
+			TRACE_SCOPE("level assets");
+			levelTextures(game, needed);
+			assets->keepOnly(needed);
+			assets->prefetch(needed);
+		}
+		reportResidency();
+		audio->playMusic(levelMusic(level).c_str());
+		levelEmitters(game);
 
 		/* Draw in loop */
 		while (!glfwWindowShouldClose(window)) {
+			if(shaderWatcher && shaderWatcher->poll())
+				resolveLocations();
 			movePlayer();
+			updateEmitters(game);
+			updateAgents(*jobs, game.course, crowd);
 			draw(window, level);
 
 			// Swap Frame Buffer in double buffering
 			glfwSwapBuffers(window);
+			pacer.endFrame();
 
 			// Poll for Keyboard and mouse events
 			glfwPollEvents();
 
-			// Control based on time (Time based transformation like 5 degrees rotation every 0.5s)
-			current_time = glfwGetTime(); // Time in seconds
-			if ((current_time - last_update_time) >= 0.5) { // atleast 0.5s elapsed since last frame
-				// do something every 0.5 seconds ..
-				last_update_time = current_time;
-			}
-			if(portal_reached()){
-				open_portal = 0;
-				portal_pos = -10;
-				playerposx = edge*(-nhor/2) + edge/2;
-				playerposy = 10;
-				playerposz = edge*(-nvert/2) + (nvert - 1)*edge + edge/2;
-				playerAngle = 0;
+			if(game.events & GAME_PORTAL_ENTERED){
 				camera_switch_state = 0;
 				level++;
 				break;
@@ -1722,6 +1611,8 @@ int main (int argc, char** argv)
 		}
 	}
 
+	if(shaderWatcher)
+		shaderWatcher->stop();
 	glfwTerminate();
 	exit(EXIT_SUCCESS);
 }
@@ -0,0 +1,79 @@
+#include <cstring>
+
+#include "overdraw.h"
+
+OverdrawCounter::OverdrawCounter() : framebuffer(0), color(0), depth_stencil(0), previous(0), width(0), height(0)
+{
+	memset(stats, 0, sizeof(stats));
+}
+
+OverdrawCounter::~OverdrawCounter()
+{
+	if(framebuffer){
+		glDeleteFramebuffers(1, &framebuffer);
+		glDeleteRenderbuffers(1, &color);
+		glDeleteRenderbuffers(1, &depth_stencil);
+	}
+}
+
+void OverdrawCounter::begin(int w, int h)
+{
+	if(!framebuffer){
+		glGenFramebuffers(1, &framebuffer);
+		glGenRenderbuffers(1, &color);
+		glGenRenderbuffers(1, &depth_stencil);
+	}
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previous);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	if(w != width || h != height){
+		width = w, height = h;
+		glBindRenderbuffer(GL_RENDERBUFFER, color);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+		glBindRenderbuffer(GL_RENDERBUFFER, depth_stencil);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth_stencil);
+		counts.resize((size_t)width * height);
+	}
+	glStencilMask(0xFF);
+	glClearStencil(0);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+	glEnable(GL_STENCIL_TEST);
+	glStencilFunc(GL_ALWAYS, 0, 0xFF);
+	glStencilOp(GL_KEEP, GL_KEEP, GL_INCR);
+}
+
+void OverdrawCounter::end(int pass)
+{
+	glDisable(GL_STENCIL_TEST);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width, height, GL_STENCIL_INDEX, GL_UNSIGNED_BYTE, &counts[0]);
+	glBindFramebuffer(GL_FRAMEBUFFER, previous);
+
+	Stats &s = stats[pass];
+	long long fragments = 0, overdrawn = 0;
+	int max = 0;
+	for(size_t p=0;p<counts.size();p++){
+		int count = counts[p];
+		fragments += count;
+		overdrawn += count > 1;
+		max = count > max ? count : max;
+	}
+	s.frames++;
+	s.pixels += counts.size();
+	s.fragments += fragments;
+	s.overdrawn += overdrawn;
+	s.max = max > s.max ? max : s.max;
+	s.last = counts.empty() ? 0 : (double)fragments / counts.size();
+}
+
+void OverdrawCounter::dump(FILE *out, const char *const *names) const
+{
+	for(int p=0;p<OVERDRAW_PASSES;p++){
+		const Stats &s = stats[p];
+		if(!s.frames)
+			continue;
+		fprintf(out, "overdraw %-8s frames %lld  fragments/pixel %.2f  shaded more than once %.1f%%  max %d\n",
+				names[p], s.frames, (double)s.fragments / s.pixels, 100.0 * s.overdrawn / s.pixels, s.max);
+	}
+}
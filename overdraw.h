@@ -0,0 +1,43 @@
+#ifndef OVERDRAW_H
+#define OVERDRAW_H
+
+#include <cstdio>
+#include <vector>
+
+#include <glad/glad.h>
+
+#define OVERDRAW_PASSES 2
+
+/* Counts how many fragments each pixel shades.
+ * Between begin() and end() drawing goes to an offscreen target whose
+ * stencil every fragment that passes the depth test increments; end()
+ * reads the counts back and adds them to the statistics of one pass, so
+ * several ways of drawing the same frame can be compared. */
+class OverdrawCounter {
+	public:
+		OverdrawCounter();
+		~OverdrawCounter();
+
+		void begin(int width, int height);
+		/* Back to the framebuffer bound before begin() */
+		void end(int pass);
+
+		/* Fragments per pixel of the last frame counted in pass */
+		double last(int pass) const { return stats[pass].last; }
+		void dump(FILE *out, const char *const *names) const;
+
+	private:
+		struct Stats {
+			long long frames, pixels, fragments, overdrawn;
+			int max;
+			double last;
+		};
+
+		GLuint framebuffer, color, depth_stencil;
+		GLint previous;
+		int width, height;
+		std::vector<unsigned char> counts;
+		Stats stats[OVERDRAW_PASSES];
+};
+
+#endif
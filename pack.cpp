@@ -0,0 +1,91 @@
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "pack.h"
+#include "texcache.h"
+
+int AssetPack::open(const char *filename)
+{
+	close();
+	int fd = ::open(filename, O_RDONLY);
+	if(fd < 0)
+		return 0;
+	struct stat st;
+	if(fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(PackHeader)){
+		::close(fd);
+		return 0;
+	}
+	void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if(data == MAP_FAILED)
+		return 0;
+
+	const PackHeader *header = (const PackHeader*)data;
+	size_t index_end = sizeof(PackHeader) + (size_t)header->count * sizeof(PackEntry);
+	if(header->magic != PACK_MAGIC || header->version != PACK_VERSION || index_end > (size_t)st.st_size){
+		munmap(data, st.st_size);
+		return 0;
+	}
+	const PackEntry *index = (const PackEntry*)(header + 1);
+	for(int e=0;e<header->count;e++)
+		if(index[e].offset > (size_t)st.st_size || index[e].size > st.st_size - index[e].offset){
+			munmap(data, st.st_size);
+			return 0;
+		}
+	map = data;
+	map_size = st.st_size;
+	entries = index;
+	count = header->count;
+	return 1;
+}
+
+void AssetPack::close()
+{
+	if(map)
+		munmap(map, map_size);
+	map = NULL;
+	map_size = 0;
+	entries = NULL;
+	count = 0;
+}
+
+const PackEntry *AssetPack::find(const char *name) const
+{
+	for(int e=0;e<count;e++)
+		if(!strncmp(entries[e].name, name, PACK_NAME))
+			return &entries[e];
+	return NULL;
+}
+
+AssetSpan AssetPack::span(const PackEntry &entry) const
+{
+	AssetSpan span = { (const unsigned char*)map + entry.offset, entry.size };
+	return span;
+}
+
+int AssetPack::verify(const PackEntry &entry) const
+{
+	AssetSpan contents = span(entry);
+	return hashBytes(contents.data, contents.size) == entry.hash;
+}
+
+static AssetPack assets;
+
+int openAssets(const char *filename)
+{
+	return assets.open(filename);
+}
+
+int findAsset(const char *name, AssetSpan &span, unsigned long long *hash)
+{
+	const PackEntry *entry = assets.find(name);
+	if(!entry)
+		return 0;
+	span = assets.span(*entry);
+	if(hash)
+		*hash = entry->hash;
+	return 1;
+}
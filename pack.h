@@ -0,0 +1,68 @@
+#ifndef PACK_H
+#define PACK_H
+
+#include <cstddef>
+
+/* Asset pack, written by tools/packbuild and mmap'd by the game.
+ * Layout: PackHeader, count PackEntry, then the contents of every file,
+ * each starting on a PACK_ALIGN (page) boundary. */
+#define PACK_MAGIC 0x4b415041 // "APAK"
+#define PACK_VERSION 1
+#define PACK_ALIGN 4096
+#define PACK_NAME 64
+
+/* Default pack, next to the loose files it replaces */
+#define ASSET_PACK "adventura.pak"
+
+struct PackHeader {
+	unsigned magic, version, count, pad;
+};
+
+struct PackEntry {
+	char name[PACK_NAME]; // path the game opens, e.g. images/front.png
+	unsigned long long offset, size;
+	unsigned long long hash; // hashBytes() of the contents
+};
+
+/* Bytes of one packed file, pointing into the mapping */
+struct AssetSpan {
+	const unsigned char *data;
+	size_t size;
+};
+
+/* Read only view of a pack file */
+class AssetPack {
+	public:
+		AssetPack() : map(NULL), map_size(0), entries(NULL), count(0) {}
+		~AssetPack() { close(); }
+
+		/* Map the file. Returns 0 if it is missing or not a pack of this version. */
+		int open(const char *filename);
+		void close();
+		int isOpen() const { return map != NULL; }
+
+		int size() const { return count; }
+		const PackEntry &entry(int e) const { return entries[e]; }
+		const PackEntry *find(const char *name) const;
+		AssetSpan span(const PackEntry &entry) const;
+		/* Check the contents of entry against its hash */
+		int verify(const PackEntry &entry) const;
+
+	private:
+		AssetPack(const AssetPack&);
+		AssetPack &operator=(const AssetPack&);
+
+		void *map;
+		size_t map_size;
+		const PackEntry *entries;
+		int count;
+};
+
+/* Open the pack every loader looks in before falling back to loose files.
+   Returns 0 if there is none. Call before starting threads or forking. */
+int openAssets(const char *filename);
+/* Contents of name in the open pack, and optionally its hash.
+   Returns 0 if no pack is open or name isn't in it. */
+int findAsset(const char *name, AssetSpan &span, unsigned long long *hash = NULL);
+
+#endif
@@ -0,0 +1,47 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "pcmcache.h"
+
+int PcmCache::open(const char *filename, unsigned long long hash, unsigned rate, unsigned channels)
+{
+	close();
+	int fd = ::open(filename, O_RDONLY);
+	if(fd < 0)
+		return 0;
+	struct stat st;
+	if(fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(PcmCacheHeader)){
+		::close(fd);
+		return 0;
+	}
+	void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if(data == MAP_FAILED)
+		return 0;
+
+	const PcmCacheHeader *header = (const PcmCacheHeader*)data;
+	// Divided rather than multiplied, so a corrupt frame count cannot wrap around
+	unsigned long long room = (st.st_size - sizeof(PcmCacheHeader)) / ((unsigned long long)channels * sizeof(short));
+	if(header->magic != PCMCACHE_MAGIC || header->version != PCMCACHE_VERSION || header->hash != hash ||
+			header->rate != rate || !channels || header->channels != channels || header->frames > room){
+		munmap(data, st.st_size);
+		return 0;
+	}
+	// Read front to back once: let the kernel read ahead and drop pages behind
+	madvise(data, st.st_size, MADV_SEQUENTIAL);
+	map = data;
+	map_size = st.st_size;
+	count = header->frames;
+	return 1;
+}
+
+void PcmCache::close()
+{
+	if(map)
+		munmap(map, map_size);
+	map = NULL;
+	map_size = 0;
+	count = 0;
+}
@@ -0,0 +1,45 @@
+#ifndef PCMCACHE_H
+#define PCMCACHE_H
+
+#include <cstddef>
+
+/* Decoded music, written by tools/pcmbake next to the track as "<track>.pcm"
+ * and mmap'd by the game, so playing it is a copy per block instead of a
+ * decode. Layout: PcmCacheHeader, then frames of interleaved 16-bit samples.
+ * It is only used while the hash of the source track still matches. */
+#define PCMCACHE_MAGIC 0x4d435041 // "APCM"
+#define PCMCACHE_VERSION 1
+#define PCMCACHE_SUFFIX ".pcm"
+
+struct PcmCacheHeader {
+	unsigned magic, version;
+	unsigned rate, channels;
+	unsigned long long hash; // hashBytes() of the source track
+	unsigned long long frames;
+};
+
+/* Read only view of a cache file */
+class PcmCache {
+	public:
+		PcmCache() : map(NULL), map_size(0), count(0) {}
+		~PcmCache() { close(); }
+
+		/* Map the file. Returns 0 if it is missing, of another version or
+		   format, or was decoded from a track other than hash. */
+		int open(const char *filename, unsigned long long hash, unsigned rate, unsigned channels);
+		void close();
+		int isOpen() const { return map != NULL; }
+
+		const short *samples() const { return (const short*)((const PcmCacheHeader*)map + 1); }
+		unsigned long long frames() const { return count; }
+
+	private:
+		PcmCache(const PcmCache&);
+		PcmCache &operator=(const PcmCache&);
+
+		void *map;
+		size_t map_size;
+		unsigned long long count;
+};
+
+#endif
@@ -0,0 +1,169 @@
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#include "renderscale.h"
+
+using namespace std;
+
+/* Frames between two scale changes, so each one is measured before the next */
+#define ADAPT_INTERVAL 15
+/* Weight of the newest frame in the smoothed scene time */
+#define SMOOTHING 0.1
+typedef chrono::steady_clock Clock;
+
+/* Mesa's llvmpipe, softpipe and swrast, OpenSWR, and the software renderers
+   of other platforms; their timer queries leave the rasterizing out */
+static int softwareRenderer()
+{
+	const char *renderer = (const char*)glGetString(GL_RENDERER);
+	if(!renderer)
+		return 0;
+	static const char *const names[] = { "llvmpipe", "softpipe", "swrast", "SWR", "Software" };
+	for(int n=0;n<sizeof(names)/sizeof(names[0]);n++)
+		if(strstr(renderer, names[n]))
+			return 1;
+	return 0;
+}
+
+RenderScale::RenderScale() : dynamic(0), target_hz(60), scale(1), lowest(1), scene_seconds(0), wall_clock(0),
+	frames_since_adapt(0), frames(0), scale_sum(0),
+	framebuffer(0), color(0), depth_stencil(0), width(0), height(0), scaled_width(0), scaled_height(0),
+	query_next(0), query_count(0), timing(0)
+{
+}
+
+RenderScale::~RenderScale()
+{
+	if(framebuffer){
+		glDeleteFramebuffers(1, &framebuffer);
+		glDeleteRenderbuffers(1, &color);
+		glDeleteRenderbuffers(1, &depth_stencil);
+		glDeleteQueries(RENDERSCALE_QUERIES, queries);
+	}
+}
+
+int RenderScale::configure(const char *spec)
+{
+	if(!spec || !*spec)
+		return 0;
+	if(!strncmp(spec, "dynamic", 7) && (!spec[7] || spec[7] == ':')){
+		double hz = spec[7] ? atof(spec + 8) : 60;
+		if(hz <= 0)
+			return 0;
+		dynamic = 1;
+		target_hz = hz;
+		scale = lowest = 1;
+		return 1;
+	}
+	char *end;
+	double fixed = strtod(spec, &end);
+	if(*end || fixed < RENDERSCALE_MIN || fixed > 1)
+		return 0;
+	dynamic = 0;
+	scale = lowest = fixed;
+	return 1;
+}
+
+void RenderScale::begin(int w, int h)
+{
+	if(!framebuffer){
+		glGenFramebuffers(1, &framebuffer);
+		glGenRenderbuffers(1, &color);
+		glGenRenderbuffers(1, &depth_stencil);
+		glGenQueries(RENDERSCALE_QUERIES, queries);
+		wall_clock = softwareRenderer();
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	if(w != width || h != height){
+		width = w, height = h;
+		glBindRenderbuffer(GL_RENDERBUFFER, color);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+		glBindRenderbuffer(GL_RENDERBUFFER, depth_stencil);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth_stencil);
+	}
+
+	timing = 0;
+	started = Clock::now();
+	if(dynamic && !wall_clock){
+		// The oldest query has had RENDERSCALE_QUERIES - 1 frames to finish
+		if(query_count){
+			int oldest = (query_next + RENDERSCALE_QUERIES - query_count) % RENDERSCALE_QUERIES;
+			GLint available = 0;
+			glGetQueryObjectiv(queries[oldest], GL_QUERY_RESULT_AVAILABLE, &available);
+			if(available){
+				GLuint64 nsec = 0;
+				glGetQueryObjectui64v(queries[oldest], GL_QUERY_RESULT, &nsec);
+				query_count--;
+				adapt(nsec / 1e9);
+			}
+		}
+		// With every query still busy this frame goes untimed rather than waiting
+		if(query_count < RENDERSCALE_QUERIES){
+			glBeginQuery(GL_TIME_ELAPSED, queries[query_next]);
+			timing = 1;
+		}
+	}
+
+	scaled_width = max(1, (int)lround(width * scale));
+	scaled_height = max(1, (int)lround(height * scale));
+	glViewport(0, 0, scaled_width, scaled_height);
+	frames++;
+	scale_sum += scale;
+}
+
+void RenderScale::end()
+{
+	if(timing){
+		glEndQuery(GL_TIME_ELAPSED);
+		query_next = (query_next + 1) % RENDERSCALE_QUERIES;
+		query_count++;
+	}
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	glBlitFramebuffer(0, 0, scaled_width, scaled_height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	if(dynamic && wall_clock){
+		glFinish();
+		adapt(chrono::duration<double>(Clock::now() - started).count());
+	}
+	glClear(GL_DEPTH_BUFFER_BIT);
+	glViewport(0, 0, width, height);
+}
+
+void RenderScale::adapt(double seconds)
+{
+	scene_seconds = scene_seconds ? scene_seconds + SMOOTHING * (seconds - scene_seconds) : seconds;
+	if(++frames_since_adapt < ADAPT_INTERVAL)
+		return;
+	double budget = 1.0 / target_hz;
+	float next = scale;
+	// The scene costs about its pixel count, the square of the scale
+	if(scene_seconds > budget * 1.05)
+		next = max(RENDERSCALE_MIN, floorf(scale * sqrt(budget / scene_seconds) / RENDERSCALE_STEP) * RENDERSCALE_STEP);
+	else if(scale < 1){
+		float up = min(1.0f, scale + RENDERSCALE_STEP);
+		if(scene_seconds * (up / scale) * (up / scale) < budget * 0.85)
+			next = up;
+	}
+	if(next != scale){
+		// Scenes at the old scale are still in flight; start measuring afresh
+		scene_seconds = scene_seconds * (next / scale) * (next / scale);
+		scale = next;
+		lowest = min(lowest, scale);
+		frames_since_adapt = 0;
+	}
+}
+
+void RenderScale::dump(FILE *out) const
+{
+	if(dynamic)
+		fprintf(out, "render scale: dynamic %.1f Hz, now %.2f, lowest %.2f, mean %.2f, scene %.2f ms (%s)\n",
+				target_hz, scale, lowest, frames ? scale_sum / frames : scale, scene_seconds * 1000,
+				wall_clock ? "wall clock" : "GPU timer");
+	else
+		fprintf(out, "render scale: %.2f\n", scale);
+}
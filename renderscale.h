@@ -0,0 +1,66 @@
+#ifndef RENDERSCALE_H
+#define RENDERSCALE_H
+
+#include <cstdio>
+#include <chrono>
+
+#include <glad/glad.h>
+
+#define RENDERSCALE_MIN 0.25f
+#define RENDERSCALE_STEP 0.05f
+/* Timer queries in flight, read back this many frames late so they never stall */
+#define RENDERSCALE_QUERIES 4
+
+/* Renders the 3D scene into an offscreen target at a fraction of the
+ * framebuffer resolution and stretches it over the framebuffer, leaving
+ * the HUD to be drawn on top at full resolution.
+ *   1          native resolution, no offscreen target (default)
+ *   0.25..1    fixed scale of both sides
+ *   dynamic:N  start at native resolution and step the scale down while
+ *              the scene takes longer than 1/N s, and back up once the
+ *              next step would still fit comfortably
+ * The scene is timed with GPU timer queries, except on software
+ * rasterizers, which leave the rasterizing out of those: there it is timed
+ * on the wall clock from begin() to a glFinish() after the blit instead.
+ * The target is allocated at full size once, smaller scales only render
+ * into its corner, so changing scale never reallocates. */
+class RenderScale {
+	public:
+		RenderScale();
+		~RenderScale();
+
+		/* Parse "0.5", "dynamic" or "dynamic:60". Returns 0 on a bad spec. */
+		int configure(const char *spec);
+		/* Whether begin() and end() are needed at all */
+		int active() const { return dynamic || scale < 1; }
+		float current() const { return scale; }
+
+		/* Bind the offscreen target for a width x height framebuffer,
+		   with the viewport at the current scale */
+		void begin(int width, int height);
+		/* Stretch the scene over the default framebuffer, clear its depth
+		   for the HUD and set the viewport back to full size */
+		void end();
+
+		void dump(FILE *out) const;
+
+	private:
+		void adapt(double seconds);
+
+		int dynamic;
+		double target_hz;
+		float scale, lowest;
+		double scene_seconds; // smoothed time of the scene
+		int wall_clock;
+		std::chrono::steady_clock::time_point started;
+		int frames_since_adapt;
+		long long frames;
+		double scale_sum;
+
+		GLuint framebuffer, color, depth_stencil;
+		int width, height, scaled_width, scaled_height;
+		GLuint queries[RENDERSCALE_QUERIES];
+		int query_next, query_count, timing;
+};
+
+#endif
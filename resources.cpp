@@ -0,0 +1,190 @@
+#include <cstring>
+
+#include "resources.h"
+#include "texcache.h"
+#include "textures.h"
+
+using namespace std;
+
+ResourceHandle::ResourceHandle(ResourceManager *owner, int slot) : owner(owner), slot(slot)
+{
+	owner->retain(slot);
+}
+
+ResourceHandle::ResourceHandle(const ResourceHandle &other) : owner(other.owner), slot(other.slot)
+{
+	if(owner)
+		owner->retain(slot);
+}
+
+ResourceHandle &ResourceHandle::operator=(const ResourceHandle &other)
+{
+	// Retain first, in case both name the same resource
+	if(other.owner)
+		other.owner->retain(other.slot);
+	reset();
+	owner = other.owner;
+	slot = other.slot;
+	return *this;
+}
+
+void ResourceHandle::reset()
+{
+	if(owner)
+		owner->release(slot);
+	owner = NULL;
+	slot = -1;
+}
+
+static unsigned long long textureKey(const char *filename)
+{
+	return hashBytes(filename, strlen(filename), hashBytes("texture", 7));
+}
+
+/* Memory of every level of the texture id, as the driver reports it */
+static size_t textureBytes(GLuint id)
+{
+	size_t bytes = 0;
+	glBindTexture(GL_TEXTURE_2D, id);
+	for(int level=0;level<16;level++){
+		GLint w = 0, h = 0, compressed = 0, size = 0;
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_WIDTH, &w);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_HEIGHT, &h);
+		if(!w || !h)
+			break;
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED, &compressed);
+		if(compressed)
+			glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+		bytes += compressed ? size : (size_t)w * h * 4;
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+	return bytes;
+}
+
+ResourceHandle ResourceManager::lookup(unsigned long long key)
+{
+	map<unsigned long long, int>::iterator it = interned.find(key);
+	if(it == interned.end())
+		return ResourceHandle();
+	return ResourceHandle(this, it->second);
+}
+
+int ResourceManager::allocate(int kind, unsigned long long key, size_t bytes)
+{
+	int slot;
+	if(free_slots.empty()){
+		slot = slots.size();
+		slots.push_back(Slot());
+	}
+	else{
+		slot = free_slots.back();
+		free_slots.pop_back();
+	}
+	Slot &s = slots[slot];
+	memset(&s, 0, sizeof(s));
+	s.kind = kind;
+	s.key = key;
+	s.bytes = bytes;
+	interned[key] = slot;
+	resident_bytes[kind] += bytes;
+	resident_count[kind]++;
+	return slot;
+}
+
+void ResourceManager::release(int slot)
+{
+	Slot &s = slots[slot];
+	if(--s.refs > 0)
+		return;
+	if(s.kind == RESOURCE_TEXTURE)
+		glDeleteTextures(1, &s.texture);
+	else{
+		glDeleteVertexArrays(1, &s.mesh.VertexArrayID);
+		GLuint buffers[3] = { s.mesh.VertexBuffer, s.mesh.ColorBuffer, s.mesh.TextureBuffer };
+		glDeleteBuffers(3, buffers); // zero names are ignored
+	}
+	interned.erase(s.key);
+	resident_bytes[s.kind] -= s.bytes;
+	resident_count[s.kind]--;
+	free_slots.push_back(slot);
+}
+
+ResourceHandle ResourceManager::texture(const char *filename)
+{
+	ResourceHandle handle = lookup(textureKey(filename));
+	if(handle.valid())
+		return handle;
+	GLuint id = createTexture(filename);
+	if(!id)
+		return handle;
+	int slot = allocate(RESOURCE_TEXTURE, textureKey(filename), textureBytes(id));
+	slots[slot].texture = id;
+	return ResourceHandle(this, slot);
+}
+
+ResourceHandle ResourceManager::adoptTexture(const char *filename, GLuint id)
+{
+	ResourceHandle handle = lookup(textureKey(filename));
+	if(handle.valid()){
+		if(id != textureID(handle))
+			glDeleteTextures(1, &id);
+		return handle;
+	}
+	if(!id)
+		return handle;
+	int slot = allocate(RESOURCE_TEXTURE, textureKey(filename), textureBytes(id));
+	slots[slot].texture = id;
+	return ResourceHandle(this, slot);
+}
+
+ResourceHandle ResourceManager::mesh(int numVertices, const GLfloat *vertices, const GLfloat *colours, const GLfloat *uvs)
+{
+	unsigned long long key = hashBytes("mesh", 4);
+	key = hashBytes(&numVertices, sizeof(numVertices), key);
+	key = hashBytes(vertices, 3*numVertices*sizeof(GLfloat), key);
+	int present = (colours ? 1 : 0) | (uvs ? 2 : 0);
+	key = hashBytes(&present, sizeof(present), key);
+	if(colours)
+		key = hashBytes(colours, 3*numVertices*sizeof(GLfloat), key);
+	if(uvs)
+		key = hashBytes(uvs, 2*numVertices*sizeof(GLfloat), key);
+	ResourceHandle handle = lookup(key);
+	if(handle.valid())
+		return handle;
+
+	size_t bytes = (3 + (colours ? 3 : 0) + (uvs ? 2 : 0)) * numVertices * sizeof(GLfloat);
+	int slot = allocate(RESOURCE_MESH, key, bytes);
+	MeshBuffers &mesh = slots[slot].mesh;
+
+	// Create Vertex Array Object
+	// Should be done after CreateWindow and before any other GL calls
+	glGenVertexArrays(1, &mesh.VertexArrayID); // VAO
+	glBindVertexArray (mesh.VertexArrayID); // Bind the VAO
+
+	glGenBuffers (1, &mesh.VertexBuffer); // VBO - vertices
+	glBindBuffer (GL_ARRAY_BUFFER, mesh.VertexBuffer); // Bind the VBO vertices
+	glBufferData (GL_ARRAY_BUFFER, 3*numVertices*sizeof(GLfloat), vertices, GL_STATIC_DRAW); // Copy the vertices into VBO
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0); // attribute 0. Vertices (x,y,z)
+
+	if(colours){
+		glGenBuffers (1, &mesh.ColorBuffer); // VBO - colors
+		glBindBuffer (GL_ARRAY_BUFFER, mesh.ColorBuffer); // Bind the VBO colors
+		glBufferData (GL_ARRAY_BUFFER, 3*numVertices*sizeof(GLfloat), colours, GL_STATIC_DRAW); // Copy the vertex colors
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (void*)0); // attribute 1. Color (r,g,b)
+	}
+	if(uvs){
+		glGenBuffers (1, &mesh.TextureBuffer); // VBO - textures
+		glBindBuffer (GL_ARRAY_BUFFER, mesh.TextureBuffer); // Bind the VBO textures
+		glBufferData (GL_ARRAY_BUFFER, 2*numVertices*sizeof(GLfloat), uvs, GL_STATIC_DRAW); // Copy the texture coordinates
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, (void*)0); // attribute 2. Textures (s,t)
+	}
+	glBindVertexArray (0);
+	return ResourceHandle(this, slot);
+}
+
+void ResourceManager::report(FILE *out) const
+{
+	fprintf(out, "Resident: %d textures %.1f MB, %d meshes %.1f MB\n",
+			resident_count[RESOURCE_TEXTURE], resident_bytes[RESOURCE_TEXTURE] / (1024.0 * 1024.0),
+			resident_count[RESOURCE_MESH], resident_bytes[RESOURCE_MESH] / (1024.0 * 1024.0));
+}
@@ -0,0 +1,95 @@
+#ifndef RESOURCES_H
+#define RESOURCES_H
+
+#include <cstdio>
+#include <map>
+#include <vector>
+
+#include <glad/glad.h>
+
+#define RESOURCE_TEXTURE 0
+#define RESOURCE_MESH 1
+
+class ResourceManager;
+
+/* Counted reference to a texture or mesh owned by a ResourceManager.
+ * Copies share the resource; its GL objects are deleted when the last
+ * handle to it is reset or destroyed. */
+class ResourceHandle {
+	public:
+		ResourceHandle() : owner(NULL), slot(-1) {}
+		ResourceHandle(const ResourceHandle &other);
+		ResourceHandle &operator=(const ResourceHandle &other);
+		~ResourceHandle() { reset(); }
+
+		int valid() const { return owner != NULL; }
+		void reset();
+
+	private:
+		friend class ResourceManager;
+		ResourceHandle(ResourceManager *owner, int slot);
+
+		ResourceManager *owner;
+		int slot;
+};
+
+/* GL objects of one uploaded mesh. The vertex array has positions on
+   attribute 0, colours on 1 and texture coordinates on 2 (0 if absent). */
+struct MeshBuffers {
+	GLuint VertexArrayID;
+	GLuint VertexBuffer;
+	GLuint ColorBuffer;
+	GLuint TextureBuffer;
+};
+
+/* Interns textures by path and meshes by content, so asking twice for the
+ * same image or the same vertex data hands out the GL objects uploaded the
+ * first time. Keeps count of what is resident. */
+class ResourceManager {
+	public:
+		ResourceManager() { resident_bytes[0] = resident_bytes[1] = 0; resident_count[0] = resident_count[1] = 0; }
+
+		/* The texture of filename, loaded with createTexture if nobody holds it */
+		ResourceHandle texture(const char *filename);
+		/* Take ownership of a texture loaded elsewhere, e.g. by loadTextures.
+		   If filename is resident already, id is deleted and the resident one returned. */
+		ResourceHandle adoptTexture(const char *filename, GLuint id);
+
+		/* Upload numVertices vertices, or share the buffers of identical data
+		   uploaded before. colours (rgb) and uvs (st) may be NULL. */
+		ResourceHandle mesh(int numVertices, const GLfloat *vertices, const GLfloat *colours, const GLfloat *uvs);
+
+		GLuint textureID(const ResourceHandle &handle) const { return slots[handle.slot].texture; }
+		const MeshBuffers &meshBuffers(const ResourceHandle &handle) const { return slots[handle.slot].mesh; }
+
+		/* Bytes of texture and buffer memory held by live resources */
+		size_t residentBytes() const { return resident_bytes[0] + resident_bytes[1]; }
+		size_t residentBytes(int kind) const { return resident_bytes[kind]; }
+		int residentCount(int kind) const { return resident_count[kind]; }
+		void report(FILE *out) const;
+
+	private:
+		friend class ResourceHandle;
+
+		struct Slot {
+			int kind;
+			int refs;
+			unsigned long long key;
+			size_t bytes;
+			GLuint texture;
+			MeshBuffers mesh;
+		};
+
+		ResourceHandle lookup(unsigned long long key);
+		int allocate(int kind, unsigned long long key, size_t bytes);
+		void retain(int slot) { slots[slot].refs++; }
+		void release(int slot);
+
+		std::vector<Slot> slots;
+		std::vector<int> free_slots;
+		std::map<unsigned long long, int> interned; // key -> slot
+		size_t resident_bytes[2];
+		int resident_count[2];
+};
+
+#endif
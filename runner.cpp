@@ -0,0 +1,107 @@
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <cstring>
+
+#include "runner.h"
+#include "jobsystem.h"
+
+using namespace std;
+
+#define RUNNER_GRAIN 16
+
+int loadScript(InputScript &script, const char *filename)
+{
+	ifstream in(filename);
+	if(!in.is_open())
+		return 0;
+	script.ticks.clear();
+	string line;
+	while(getline(in, line)){
+		if(line.empty() || line[0] == '#')
+			continue;
+		istringstream words(line);
+		int count;
+		string keys;
+		if(!(words >> count))
+			continue;
+		words >> keys;
+		unsigned char bits = 0;
+		for(int k=0;k<keys.size();k++)
+			switch(keys[k]){
+				case 'F': bits |= INPUT_FRONT; break;
+				case 'B': bits |= INPUT_BACK; break;
+				case 'L': bits |= INPUT_LEFT; break;
+				case 'R': bits |= INPUT_RIGHT; break;
+				case '<': bits |= INPUT_TURN_LEFT; break;
+				case '>': bits |= INPUT_TURN_RIGHT; break;
+				case 'J': bits |= INPUT_JUMP; break;
+			}
+		script.ticks.insert(script.ticks.end(), count, bits);
+	}
+	return 1;
+}
+
+void BatchRunner::start(const vector<const Course*> &courses, const vector<const InputScript*> &scripts)
+{
+	// Instances hold pointers to themselves in their trigger handlers, so size once
+	games.clear();
+	games.resize(courses.size());
+	script_of.resize(courses.size());
+	finish_tick.assign(courses.size(), -1);
+	for(int i=0;i<courses.size();i++){
+		startCourse(games[i], *courses[i]);
+		games[i].player.seed = 1 + i;
+		script_of[i] = scripts.empty() ? NULL : scripts[i % scripts.size()];
+	}
+}
+
+void BatchRunner::stepInstance(int i, InstanceFrame *frame)
+{
+	GameInstance &g = games[i];
+	if(finish_tick[i] < 0){
+		const InputScript *script = script_of[i];
+		Agent &p = g.player;
+		if(!script || script->ticks.empty())
+			thinkAgent(g.course, p);
+		else{
+			unsigned char bits = script->ticks[min((size_t)g.ticks, script->ticks.size() - 1)];
+			p.movefront = (bits & INPUT_FRONT) != 0;
+			p.moveback = (bits & INPUT_BACK) != 0;
+			p.moveleft = (bits & INPUT_LEFT) != 0;
+			p.moveright = (bits & INPUT_RIGHT) != 0;
+			p.turn_left = (bits & INPUT_TURN_LEFT) != 0;
+			p.turn_right = (bits & INPUT_TURN_RIGHT) != 0;
+			if(bits & INPUT_JUMP)
+				jumpAgent(g.course, p);
+		}
+		stepGame(g);
+		if(g.events & GAME_PORTAL_ENTERED)
+			finish_tick[i] = g.ticks;
+	}
+	else
+		g.events = 0;
+
+	if(frame){
+		frame->posx = g.player.posx;
+		frame->posy = g.player.posy;
+		frame->posz = g.player.posz;
+		frame->angle = g.player.angle;
+		frame->treasure_left = g.treasure.size();
+		frame->events = g.events;
+		frame->finished = finish_tick[i];
+		frame->pad = 0;
+	}
+}
+
+void BatchRunner::run(int ticks, InstanceFrame *out)
+{
+	int n = games.size();
+	for(int t=0;t<ticks;t++){
+		InstanceFrame *row = out ? out + (size_t)t * n : NULL;
+		jobs.parallelFor(n, RUNNER_GRAIN, [this, row](int begin, int end){
+			for(int i=begin;i<end;i++)
+				stepInstance(i, row ? row + i : NULL);
+		});
+	}
+}
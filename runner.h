@@ -0,0 +1,66 @@
+#ifndef RUNNER_H
+#define RUNNER_H
+
+#include <vector>
+
+#include "game.h"
+
+class JobSystem;
+
+/* Input bits of a scripted tick */
+#define INPUT_FRONT 1
+#define INPUT_BACK 2
+#define INPUT_LEFT 4
+#define INPUT_RIGHT 8
+#define INPUT_TURN_LEFT 16
+#define INPUT_TURN_RIGHT 32
+#define INPUT_JUMP 64
+
+/* Scripted playthrough: one byte of INPUT_* bits per tick.
+ * An empty script lets the player wander like a crowd agent. */
+struct InputScript {
+	std::vector<unsigned char> ticks;
+};
+
+/* Read a script file made of "<ticks> <keys>" lines, keys being any of
+   F(ront) B(ack) L(eft) R(ight) < > (turn) J(ump) or - for none.
+   Lines starting with # are ignored. Returns 0 if the file could not be read. */
+int loadScript(InputScript &script, const char *filename);
+
+/* State of one instance after one tick, as written to the shared output buffer */
+struct InstanceFrame {
+	float posx, posy, posz, angle;
+	int treasure_left;
+	int events;
+	int finished; // tick the portal was entered, -1 while still playing
+	int pad;
+};
+
+/* Steps many independent games in lockstep on a job system.
+ * Every tick is one parallelFor over the instances; the frames of tick t
+ * land in row t of the caller's buffer, so a run fills one contiguous array. */
+class BatchRunner {
+	public:
+		explicit BatchRunner(JobSystem &jobs) : jobs(jobs) {}
+
+		/* One instance per course, instance i playing scripts[i % scripts.size()] */
+		void start(const std::vector<const Course*> &courses, const std::vector<const InputScript*> &scripts);
+
+		int count() const { return games.size(); }
+		const GameInstance &game(int i) const { return games[i]; }
+		int finished(int i) const { return finish_tick[i]; }
+
+		/* Step every instance ticks times. out must hold ticks * count() frames;
+		   frame (t, i) is out[t * count() + i]. out may be NULL. */
+		void run(int ticks, InstanceFrame *out);
+
+	private:
+		void stepInstance(int i, InstanceFrame *frame);
+
+		JobSystem &jobs;
+		std::vector<GameInstance> games;
+		std::vector<const InputScript*> script_of;
+		std::vector<int> finish_tick;
+};
+
+#endif
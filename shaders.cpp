@@ -0,0 +1,287 @@
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <sys/stat.h>
+
+#include "shaders.h"
+#include "texcache.h"
+#include "pack.h"
+#include "trace.h"
+
+using namespace std;
+
+#define SHADER_CACHE_MAGIC 0x42505341 // "ASPB"
+
+struct ProgramBinaryHeader {
+	unsigned magic;
+	unsigned format;
+	unsigned long long key;
+	unsigned length, pad;
+};
+
+/* packed = 0 skips the asset pack, so edits to loose files are seen */
+static int readFile(const char *filename, string &text, int packed = 1)
+{
+	AssetSpan span;
+	if(packed && findAsset(filename, span)){
+		text.assign((const char*)span.data, span.size);
+		return 1;
+	}
+	FILE *in = fopen(filename, "rb");
+	if(!in)
+		return 0;
+	char buffer[4096];
+	size_t got;
+	text.clear();
+	while((got = fread(buffer, 1, sizeof(buffer), in)) > 0)
+		text.append(buffer, got);
+	fclose(in);
+	return 1;
+}
+
+/* Put "#define NAME 1" for every space separated name in defines right
+   after the #version line, which must stay first, and restart the line
+   numbering so compiler messages still point into the file */
+static void injectDefines(string &code, const char *defines)
+{
+	if(!defines || !*defines)
+		return;
+	size_t at = 0;
+	if(!code.compare(0, 8, "#version")){
+		at = code.find('\n');
+		if(at == string::npos)
+			code += '\n', at = code.size() - 1;
+		at++;
+	}
+	string lines;
+	const char *name = defines;
+	while(*name){
+		size_t length = strcspn(name, " ");
+		if(length)
+			lines += "#define " + string(name, length) + " 1\n";
+		name += length + (name[length] == ' ');
+	}
+	char restart[32];
+	snprintf(restart, sizeof(restart), "#line %d\n", at ? 2 : 1);
+	code.insert(at, lines + restart);
+}
+
+/* Sources plus everything that makes a binary unusable when it changes */
+static unsigned long long programKey(const string &vertex, const string &fragment)
+{
+	unsigned long long key = hashBytes(vertex.data(), vertex.size());
+	key = hashBytes("\0", 1, key);
+	key = hashBytes(fragment.data(), fragment.size(), key);
+	const GLenum strings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+	for(int s=0;s<3;s++){
+		const char *value = (const char*)glGetString(strings[s]);
+		key = hashBytes("\0", 1, key);
+		if(value)
+			key = hashBytes(value, string(value).size(), key);
+	}
+	return key;
+}
+
+static void cacheFile(unsigned long long key, char *filename, int size)
+{
+	snprintf(filename, size, "%s/%016llx.bin", SHADER_CACHE_DIR, key);
+}
+
+static int binariesSupported()
+{
+	if(!GLAD_GL_ARB_get_program_binary)
+		return 0;
+	GLint formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	return formats > 0;
+}
+
+/* Returns 0 if there is no usable binary for key */
+static GLuint loadProgramBinary(unsigned long long key)
+{
+	TRACE_SCOPE("loadProgramBinary");
+	char filename[256];
+	cacheFile(key, filename, sizeof(filename));
+	FILE *in = fopen(filename, "rb");
+	if(!in)
+		return 0;
+	ProgramBinaryHeader header;
+	vector<char> binary;
+	int ok = fread(&header, sizeof(header), 1, in) == 1 && header.magic == SHADER_CACHE_MAGIC && header.key == key;
+	if(ok){
+		binary.resize(header.length);
+		ok = header.length && fread(&binary[0], 1, header.length, in) == header.length;
+	}
+	fclose(in);
+	if(!ok)
+		return 0;
+
+	GLuint ProgramID = glCreateProgram();
+	glProgramBinary(ProgramID, header.format, &binary[0], header.length);
+	GLint Result = GL_FALSE;
+	glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
+	if(Result != GL_TRUE){
+		// Driver update or a binary it no longer accepts: rebuild from source
+		glDeleteProgram(ProgramID);
+		return 0;
+	}
+	return ProgramID;
+}
+
+static void saveProgramBinary(GLuint ProgramID, unsigned long long key)
+{
+	GLint length = 0;
+	glGetProgramiv(ProgramID, GL_PROGRAM_BINARY_LENGTH, &length);
+	if(length <= 0)
+		return;
+	vector<char> binary(length);
+	GLenum format;
+	glGetProgramBinary(ProgramID, length, &length, &format, &binary[0]);
+
+	mkdir(SHADER_CACHE_DIR, 0755);
+	char filename[256], temp[264];
+	cacheFile(key, filename, sizeof(filename));
+	snprintf(temp, sizeof(temp), "%s.tmp", filename);
+	FILE *out = fopen(temp, "wb");
+	if(!out)
+		return;
+	ProgramBinaryHeader header = { SHADER_CACHE_MAGIC, format, key, (unsigned)length, 0 };
+	int ok = fwrite(&header, sizeof(header), 1, out) == 1 && fwrite(&binary[0], 1, length, out) == (size_t)length;
+	ok = !fclose(out) && ok;
+	// Renamed into place so a crash never leaves a truncated binary behind
+	if(!ok || rename(temp, filename))
+		remove(temp);
+}
+
+static GLuint compileShader(GLenum type, const char *file_path, const string &code, string &log)
+{
+	TRACE_SCOPE("compileShader", file_path);
+	GLuint ShaderID = glCreateShader(type);
+	char const * SourcePointer = code.c_str();
+	glShaderSource(ShaderID, 1, &SourcePointer , NULL);
+	glCompileShader(ShaderID);
+
+	// Check the shader, quietly unless the compiler had something to say
+	GLint Result = GL_FALSE;
+	int InfoLogLength;
+	glGetShaderiv(ShaderID, GL_COMPILE_STATUS, &Result);
+	glGetShaderiv(ShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+	if(Result != GL_TRUE || InfoLogLength > 1){
+		std::vector<char> ShaderErrorMessage(max(InfoLogLength, int(1)));
+		glGetShaderInfoLog(ShaderID, InfoLogLength, NULL, &ShaderErrorMessage[0]);
+		log += string("Compiling shader ") + file_path + ":\n" + &ShaderErrorMessage[0] + "\n";
+	}
+	return ShaderID;
+}
+
+/* Returns the program, or 0 with the reason in log if it did not link */
+static GLuint linkProgram(const char *vertex_file_path, const char *fragment_file_path,
+		const string &VertexShaderCode, const string &FragmentShaderCode, int retrievable, string &log)
+{
+	GLuint VertexShaderID = compileShader(GL_VERTEX_SHADER, vertex_file_path, VertexShaderCode, log);
+	GLuint FragmentShaderID = compileShader(GL_FRAGMENT_SHADER, fragment_file_path, FragmentShaderCode, log);
+
+	// Link the program
+	TRACE_SCOPE("linkProgram", fragment_file_path);
+	GLuint ProgramID = glCreateProgram();
+	glAttachShader(ProgramID, VertexShaderID);
+	glAttachShader(ProgramID, FragmentShaderID);
+	if(retrievable)
+		glProgramParameteri(ProgramID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	glLinkProgram(ProgramID);
+
+	// Check the program
+	GLint Result = GL_FALSE;
+	int InfoLogLength;
+	glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
+	glGetProgramiv(ProgramID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+	if(Result != GL_TRUE || InfoLogLength > 1){
+		std::vector<char> ProgramErrorMessage( max(InfoLogLength, int(1)) );
+		glGetProgramInfoLog(ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
+		log += string("Linking ") + vertex_file_path + " + " + fragment_file_path + ":\n" + &ProgramErrorMessage[0] + "\n";
+	}
+
+	glDetachShader(ProgramID, VertexShaderID);
+	glDetachShader(ProgramID, FragmentShaderID);
+	glDeleteShader(VertexShaderID);
+	glDeleteShader(FragmentShaderID);
+
+	if(Result != GL_TRUE){
+		glDeleteProgram(ProgramID);
+		return 0;
+	}
+	return ProgramID;
+}
+
+/* Function to load Shaders - Use it as it is */
+GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path, const char *defines) {
+	TRACE_SCOPE("LoadShaders", vertex_file_path);
+
+	// Read the shader code from the files
+	std::string VertexShaderCode, FragmentShaderCode;
+	if(!readFile(vertex_file_path, VertexShaderCode))
+		fprintf(stderr, "Unable to open %s\n", vertex_file_path);
+	if(!readFile(fragment_file_path, FragmentShaderCode))
+		fprintf(stderr, "Unable to open %s\n", fragment_file_path);
+	// The defines end up in the sources, so every variant gets its own binary
+	injectDefines(VertexShaderCode, defines);
+	injectDefines(FragmentShaderCode, defines);
+
+	int cached = binariesSupported();
+	unsigned long long key = 0;
+	if(cached){
+		key = programKey(VertexShaderCode, FragmentShaderCode);
+		GLuint ProgramID = loadProgramBinary(key);
+		if(ProgramID)
+			return ProgramID;
+	}
+
+	string log;
+	GLuint ProgramID = linkProgram(vertex_file_path, fragment_file_path, VertexShaderCode, FragmentShaderCode, cached, log);
+	if(!log.empty())
+		fprintf(stderr, "%s", log.c_str());
+	if(cached && ProgramID)
+		saveProgramBinary(ProgramID, key);
+	return ProgramID;
+}
+
+GLuint RebuildShaders(const char *vertex_file_path, const char *fragment_file_path, const char *defines, std::string &log)
+{
+	TRACE_SCOPE("RebuildShaders", vertex_file_path);
+	std::string VertexShaderCode, FragmentShaderCode;
+	if(!readFile(vertex_file_path, VertexShaderCode, 0))
+		log += string("Unable to open ") + vertex_file_path + "\n";
+	if(!readFile(fragment_file_path, FragmentShaderCode, 0))
+		log += string("Unable to open ") + fragment_file_path + "\n";
+	if(!log.empty())
+		return 0;
+	return BuildShaders(vertex_file_path, VertexShaderCode, fragment_file_path, FragmentShaderCode, defines, log);
+}
+
+GLuint BuildShaders(const char *vertex_name, std::string vertex_code, const char *fragment_name, std::string fragment_code,
+		const char *defines, std::string &log)
+{
+	injectDefines(vertex_code, defines);
+	injectDefines(fragment_code, defines);
+	return linkProgram(vertex_name, fragment_name, vertex_code, fragment_code, 0, log);
+}
+
+GLint ShaderProgram::uniform(const char *name)
+{
+	for(int u=0;u<uniforms.size();u++)
+		if(uniforms[u].first == name || !strcmp(uniforms[u].first, name))
+			return uniforms[u].second;
+	GLint location = glGetUniformLocation(id, name);
+	uniforms.push_back(make_pair(name, location));
+	return location;
+}
+
+void ShaderProgram::replace(GLuint program)
+{
+	if(id)
+		glDeleteProgram(id);
+	id = program;
+	uniforms.clear();
+}
@@ -0,0 +1,49 @@
+#ifndef SHADERS_H
+#define SHADERS_H
+
+#include <glad/glad.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+/* Linked programs are kept here as driver binaries, one file per program */
+#define SHADER_CACHE_DIR "shadercache"
+
+/* Compile and link a vertex and fragment shader pair into a program.
+   If the driver supports program binaries, a binary cached by an earlier
+   run with the same sources and the same driver is loaded instead.
+   Logs are only printed when compiling or linking reports something.
+   defines is a space separated list of names defined to 1 in both stages,
+   which is how one source file builds several program variants. */
+GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path, const char *defines = NULL);
+
+/* Build a program from the loose source files, bypassing the asset pack and
+   the binary cache. Returns 0 with the compiler and linker output in log if
+   it did not link. Works on any thread with a current context. */
+GLuint RebuildShaders(const char *vertex_file_path, const char *fragment_file_path, const char *defines, std::string &log);
+
+/* RebuildShaders for sources already in memory; the names only label the log */
+GLuint BuildShaders(const char *vertex_name, std::string vertex_code, const char *fragment_name, std::string fragment_code,
+		const char *defines, std::string &log);
+
+/* A program together with the files and defines it is built from.
+ * Uniform locations are looked up once per name and forgotten when the
+ * program is replaced, so draw code can ask for them every frame. */
+struct ShaderProgram {
+	GLuint id;
+	const char *vertex_file, *fragment_file;
+	const char *defines;
+
+	ShaderProgram(const char *vertex_file, const char *fragment_file, const char *defines = NULL) :
+		id(0), vertex_file(vertex_file), fragment_file(fragment_file), defines(defines) {}
+
+	void load() { replace(LoadShaders(vertex_file, fragment_file, defines)); }
+	/* Take over a newly linked program and delete the current one */
+	void replace(GLuint program);
+	GLint uniform(const char *name);
+
+	private:
+		std::vector<std::pair<const char*, GLint> > uniforms;
+};
+
+#endif
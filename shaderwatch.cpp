@@ -0,0 +1,170 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include "shaderwatch.h"
+#include "trace.h"
+
+using namespace std;
+
+/* Quiet time after the last change before rebuilding, editors often write twice */
+#define SHADERWATCH_SETTLE_MS 100
+
+static string directoryOf(const char *path)
+{
+	const char *slash = strrchr(path, '/');
+	return slash ? string(path, slash - path + 1) : string(".");
+}
+
+static const char *baseName(const char *path)
+{
+	const char *slash = strrchr(path, '/');
+	return slash ? slash + 1 : path;
+}
+
+ShaderWatcher::ShaderWatcher() : programs(NULL), count(0), context(NULL), inotify(-1), stopping(false)
+{
+}
+
+ShaderWatcher::~ShaderWatcher()
+{
+	stop();
+}
+
+int ShaderWatcher::start(GLFWwindow *share, ShaderProgram **watched, int n)
+{
+	stop();
+	inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if(inotify < 0)
+		return 0;
+	programs = watched;
+	count = n;
+	watches.assign(2 * n, -1);
+	logs.assign(n, string());
+	// Editors save by writing in place or by renaming a temporary over the file,
+	// and the watch on the file itself would be lost by the rename: watch directories
+	for(int p=0;p<n;p++){
+		const char *files[2] = { programs[p]->vertex_file, programs[p]->fragment_file };
+		for(int f=0;f<2;f++)
+			watches[2*p + f] = inotify_add_watch(inotify, directoryOf(files[f]).c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+	}
+
+	glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+	context = glfwCreateWindow(1, 1, "shaders", NULL, share);
+	glfwWindowHint(GLFW_VISIBLE, GL_TRUE);
+	if(!context){
+		close(inotify);
+		inotify = -1;
+		return 0;
+	}
+	stopping = false;
+	thread = std::thread(&ShaderWatcher::run, this);
+	return 1;
+}
+
+void ShaderWatcher::stop()
+{
+	if(thread.joinable()){
+		stopping = true;
+		thread.join();
+	}
+	if(context){
+		glfwDestroyWindow(context);
+		context = NULL;
+	}
+	if(inotify >= 0){
+		close(inotify);
+		inotify = -1;
+	}
+	// Programs that linked but were never swapped in
+	for(int b=0;b<built.size();b++)
+		if(built[b].id)
+			glDeleteProgram(built[b].id);
+	built.clear();
+}
+
+int ShaderWatcher::matches(int p, int wd, const char *name) const
+{
+	return (watches[2*p] == wd && !strcmp(name, baseName(programs[p]->vertex_file))) ||
+		(watches[2*p + 1] == wd && !strcmp(name, baseName(programs[p]->fragment_file)));
+}
+
+void ShaderWatcher::run()
+{
+	traceThreadName("shader watch");
+	glfwMakeContextCurrent(context);
+	vector<char> dirty(count, 0);
+	int pending = 0;
+	char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	while(!stopping){
+		struct pollfd fd = { inotify, POLLIN, 0 };
+		int ready = ::poll(&fd, 1, SHADERWATCH_SETTLE_MS);
+		if(ready > 0){
+			ssize_t got;
+			while((got = read(inotify, buffer, sizeof(buffer))) > 0)
+				for(char *at=buffer; at<buffer + got; at += sizeof(struct inotify_event) + ((struct inotify_event*)at)->len){
+					const struct inotify_event *event = (const struct inotify_event*)at;
+					if(!event->len)
+						continue;
+					for(int p=0;p<count;p++)
+						if(matches(p, event->wd, event->name)){
+							pending += !dirty[p];
+							dirty[p] = 1;
+						}
+				}
+			continue;
+		}
+		if(ready < 0 || !pending)
+			continue;
+
+		for(int p=0;p<count;p++){
+			if(!dirty[p])
+				continue;
+			dirty[p] = 0;
+			Built result;
+			result.program = p;
+			result.id = RebuildShaders(programs[p]->vertex_file, programs[p]->fragment_file, programs[p]->defines, result.log);
+			// The game's context may only use the program once it is complete here
+			glFinish();
+			lock_guard<mutex> hold(lock);
+			built.push_back(result);
+		}
+		pending = 0;
+	}
+	glfwMakeContextCurrent(NULL);
+}
+
+int ShaderWatcher::poll()
+{
+	vector<Built> ready;
+	{
+		lock_guard<mutex> hold(lock);
+		if(built.empty())
+			return 0;
+		ready.swap(built);
+	}
+	int replaced = 0;
+	for(int b=0;b<ready.size();b++){
+		ShaderProgram &program = *programs[ready[b].program];
+		if(ready[b].id){
+			program.replace(ready[b].id);
+			logs[ready[b].program].clear();
+			fprintf(stderr, "Reloaded %s + %s %s\n", program.vertex_file, program.fragment_file, program.defines ? program.defines : "");
+			replaced = 1;
+		}
+		else{
+			logs[ready[b].program] = ready[b].log;
+			fprintf(stderr, "%s", ready[b].log.c_str());
+		}
+	}
+	error_text.clear();
+	for(int p=0;p<count;p++)
+		error_text += logs[p];
+	return replaced;
+}
@@ -0,0 +1,59 @@
+#ifndef SHADERWATCH_H
+#define SHADERWATCH_H
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "shaders.h"
+
+struct GLFWwindow;
+
+/* Rebuilds programs while the game runs whenever their source files change.
+ * A thread waits on inotify and compiles in a hidden window that shares
+ * objects with the game's context, so the frame loop never stalls on the
+ * compiler. Programs that link are swapped in by poll() between frames;
+ * ones that fail leave the running program alone and report the log. */
+class ShaderWatcher {
+	public:
+		ShaderWatcher();
+		~ShaderWatcher();
+
+		/* Watch the sources of count programs. Call on the main thread with
+		   share current. Returns 0 if inotify or the hidden window fail. */
+		int start(GLFWwindow *share, ShaderProgram **programs, int count);
+		void stop();
+
+		/* Main thread, between frames. Returns 1 if a program was replaced,
+		   so locations kept outside ShaderProgram must be looked up again. */
+		int poll();
+
+		/* Compiler output of every program whose last rebuild failed */
+		const std::string &errors() const { return error_text; }
+
+	private:
+		struct Built {
+			int program;
+			GLuint id;
+			std::string log;
+		};
+
+		void run();
+		int matches(int program, int wd, const char *name) const;
+
+		ShaderProgram **programs;
+		int count;
+		GLFWwindow *context;
+		int inotify;
+		std::vector<int> watches; // per program: vertex wd, fragment wd
+		std::thread thread;
+		std::atomic<bool> stopping;
+		std::mutex lock;
+		std::vector<Built> built;
+		std::vector<std::string> logs;
+		std::string error_text;
+};
+
+#endif
@@ -0,0 +1,86 @@
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "texcache.h"
+
+unsigned long long hashBytes(const void *data, size_t size, unsigned long long hash)
+{
+	const unsigned char *bytes = (const unsigned char*)data;
+	for(size_t i=0;i<size;i++){
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+int hashFile(const char *filename, unsigned long long &hash)
+{
+	FILE *in = fopen(filename, "rb");
+	if(!in)
+		return 0;
+	unsigned char buffer[65536];
+	size_t got;
+	hash = HASH_SEED;
+	while((got = fread(buffer, 1, sizeof(buffer), in)) > 0)
+		hash = hashBytes(buffer, got, hash);
+	fclose(in);
+	return 1;
+}
+
+int TextureCache::open(const char *filename)
+{
+	close();
+	int fd = ::open(filename, O_RDONLY);
+	if(fd < 0)
+		return 0;
+	struct stat st;
+	if(fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(TexCacheHeader)){
+		::close(fd);
+		return 0;
+	}
+	void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if(data == MAP_FAILED)
+		return 0;
+
+	const TexCacheHeader *header = (const TexCacheHeader*)data;
+	size_t index_end = sizeof(TexCacheHeader) + (size_t)header->count * sizeof(TexCacheEntry);
+	if(header->magic != TEXCACHE_MAGIC || header->version != TEXCACHE_VERSION || index_end > (size_t)st.st_size){
+		munmap(data, st.st_size);
+		return 0;
+	}
+	map = data;
+	map_size = st.st_size;
+	entries = (const TexCacheEntry*)(header + 1);
+	count = header->count;
+	return 1;
+}
+
+void TextureCache::close()
+{
+	if(map)
+		munmap(map, map_size);
+	map = NULL;
+	map_size = 0;
+	entries = NULL;
+	count = 0;
+}
+
+const TexCacheEntry *TextureCache::find(const char *name) const
+{
+	for(int e=0;e<count;e++)
+		if(!strncmp(entries[e].name, name, TEXCACHE_NAME))
+			return &entries[e];
+	return NULL;
+}
+
+const unsigned char *TextureCache::level(const TexCacheEntry &entry, int level) const
+{
+	if(level >= entry.levels || entry.offset[level] + entry.size[level] > map_size)
+		return NULL;
+	return (const unsigned char*)map + entry.offset[level];
+}
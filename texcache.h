@@ -0,0 +1,63 @@
+#ifndef TEXCACHE_H
+#define TEXCACHE_H
+
+#include <cstddef>
+
+/* Baked texture cache, written by tools/texbake and mmap'd by the game.
+ * Layout: TexCacheHeader, count TexCacheEntry, then the mip levels of every
+ * texture, each level starting on a TEXCACHE_ALIGN boundary. An entry is
+ * only used while the hash of its source PNG still matches. */
+#define TEXCACHE_MAGIC 0x43585441 // "ATXC"
+#define TEXCACHE_VERSION 1
+#define TEXCACHE_ALIGN 16
+#define TEXCACHE_NAME 64
+#define TEXCACHE_LEVELS 16
+
+/* Pixel formats of the baked levels */
+#define TEXCACHE_RGBA8 0
+#define TEXCACHE_DXT1 1 // 4x4 blocks of 8 bytes, opaque textures only
+
+struct TexCacheHeader {
+	unsigned magic, version, count, pad;
+};
+
+struct TexCacheEntry {
+	char name[TEXCACHE_NAME]; // source path, e.g. images/front.png
+	unsigned long long hash; // hashBytes() of the source file
+	unsigned format, width, height, levels;
+	unsigned long long offset[TEXCACHE_LEVELS];
+	unsigned size[TEXCACHE_LEVELS];
+};
+
+#define HASH_SEED 0xcbf29ce484222325ULL
+
+/* 64 bit FNV-1a */
+unsigned long long hashBytes(const void *data, size_t size, unsigned long long hash = HASH_SEED);
+/* Hash a whole file. Returns 0 if it could not be read. */
+int hashFile(const char *filename, unsigned long long &hash);
+
+/* Read only view of a cache file */
+class TextureCache {
+	public:
+		TextureCache() : map(NULL), map_size(0), entries(NULL), count(0) {}
+		~TextureCache() { close(); }
+
+		/* Map the file. Returns 0 if it is missing or not a cache of this version. */
+		int open(const char *filename);
+		void close();
+		int isOpen() const { return map != NULL; }
+
+		const TexCacheEntry *find(const char *name) const;
+		const unsigned char *level(const TexCacheEntry &entry, int level) const;
+
+	private:
+		TextureCache(const TextureCache&);
+		TextureCache &operator=(const TextureCache&);
+
+		void *map;
+		size_t map_size;
+		const TexCacheEntry *entries;
+		int count;
+};
+
+#endif
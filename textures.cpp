@@ -0,0 +1,372 @@
+#include <iostream>
+#include <cstring>
+#include <cstdio>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include <SOIL/SOIL.h>
+
+#include "textures.h"
+#include "jobsystem.h"
+#include "pack.h"
+#include "trace.h"
+
+using namespace std;
+
+static GLuint newTexture ()
+{
+	GLuint TextureID;
+	// Generate Texture Buffer
+	glGenTextures(1, &TextureID);
+	// All upcoming GL_TEXTURE_2D operations now have effect on our texture buffer
+	glBindTexture(GL_TEXTURE_2D, TextureID);
+	// Set our texture parameters
+	// Set texture wrapping to GL_REPEAT
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	// Set texture filtering (interpolation)
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	return TextureID;
+}
+
+GLuint uploadTexture (int width, int height, const unsigned char* pixels)
+{
+	GLuint TextureID = newTexture();
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+	glGenerateMipmap(GL_TEXTURE_2D); // Generate MipMaps to use
+	glBindTexture(GL_TEXTURE_2D, 0); // Unbind texture when done, so we won't accidentily mess it up
+
+	return TextureID;
+}
+
+/* RGBA pixels of filename, decoded straight from the asset pack when it is packed */
+static unsigned char* decodeImage (const char* filename, int* width, int* height)
+{
+	AssetSpan span;
+	if(findAsset(filename, span))
+		return SOIL_load_image_from_memory(span.data, span.size, width, height, 0, SOIL_LOAD_RGBA);
+	return SOIL_load_image(filename, width, height, 0, SOIL_LOAD_RGBA);
+}
+
+/* Hash of the contents of filename, as stored for the pack or texture cache */
+static int imageHash (const char* filename, unsigned long long &hash)
+{
+	AssetSpan span;
+	if(findAsset(filename, span, &hash))
+		return 1;
+	return hashFile(filename, hash);
+}
+
+/* Halve an RGBA image in place with a 2x2 box filter, base times over.
+   Every destination texel lies before the source texels it still needs. */
+static void reduceImage (unsigned char* pixels, int &width, int &height, int base)
+{
+	for(int b=0;b<base && (width > 1 || height > 1);b++){
+		int w = max(1, width/2), h = max(1, height/2);
+		for(int y=0;y<h;y++)
+			for(int x=0;x<w;x++){
+				int x0 = min(2*x, width-1), x1 = min(2*x+1, width-1);
+				int y0 = min(2*y, height-1), y1 = min(2*y+1, height-1);
+				unsigned char texel[4];
+				for(int c=0;c<4;c++)
+					texel[c] = (pixels[((size_t)y0*width + x0)*4 + c] + pixels[((size_t)y0*width + x1)*4 + c]
+						+ pixels[((size_t)y1*width + x0)*4 + c] + pixels[((size_t)y1*width + x1)*4 + c] + 2) / 4;
+				memcpy(pixels + ((size_t)y*w + x)*4, texel, 4);
+			}
+		width = w;
+		height = h;
+	}
+}
+
+static GLuint createReducedTexture (const char* filename, int base)
+{
+	TRACE_SCOPE("createTexture", filename);
+	// Load image and create OpenGL texture
+	int twidth, theight;
+	unsigned char* image = decodeImage(filename, &twidth, &theight);
+	if(!image){
+		cout << "SOIL loading error: '" << filename << "': " << SOIL_last_result() << endl;
+		return 0;
+	}
+	reduceImage(image, twidth, theight, base);
+	GLuint TextureID = uploadTexture(twidth, theight, image);
+	SOIL_free_image_data(image); // Free the data read from file after creating opengl texture
+	return TextureID;
+}
+
+GLuint createTexture (const char* filename)
+{
+	return createReducedTexture(filename, 0);
+}
+
+GLuint uploadCachedTexture (const TextureCache &cache, const TexCacheEntry &entry, int base)
+{
+	if(entry.format == TEXCACHE_DXT1 && !GLAD_GL_EXT_texture_compression_s3tc)
+		return 0;
+	base = min(base, (int)entry.levels - 1);
+	GLuint TextureID = newTexture();
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, entry.levels - 1 - base);
+	// Every level from base on goes to GL straight out of the mapping;
+	// the pages of the skipped ones are never touched
+	for(int l=base;l<entry.levels;l++){
+		const unsigned char* data = cache.level(entry, l);
+		if(!data){
+			glBindTexture(GL_TEXTURE_2D, 0);
+			glDeleteTextures(1, &TextureID);
+			return 0;
+		}
+		int w = max(1u, entry.width >> l), h = max(1u, entry.height >> l);
+		if(entry.format == TEXCACHE_DXT1)
+			glCompressedTexImage2D(GL_TEXTURE_2D, l - base, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, w, h, 0, entry.size[l], data);
+		else
+			glTexImage2D(GL_TEXTURE_2D, l - base, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+	return TextureID;
+}
+
+struct DecodedImage {
+	int request;
+	int width, height;
+	unsigned char* pixels;
+	const TexCacheEntry* entry; // up to date cache entry, nothing decoded
+};
+
+void loadTextures (JobSystem &jobs, const TextureRequest* requests, int count, const TextureCache* cache)
+{
+	TRACE_SCOPE("loadTextures");
+	// Finished decodes, handed from the workers to this (GL) thread
+	mutex lock;
+	condition_variable ready;
+	deque<DecodedImage> decoded;
+
+	for(int r=0;r<count;r++)
+		jobs.submit([&, r]{
+			DecodedImage image;
+			const char* filename = requests[r].filename;
+			TRACE_SCOPE("decode", filename);
+			image.request = r;
+			image.pixels = NULL;
+			image.entry = cache ? cache->find(filename) : NULL;
+			unsigned long long hash;
+			if(image.entry && !(imageHash(filename, hash) && hash == image.entry->hash))
+				image.entry = NULL;
+			if(!image.entry){
+				image.pixels = decodeImage(filename, &image.width, &image.height);
+				if(image.pixels)
+					reduceImage(image.pixels, image.width, image.height, requests[r].base_level);
+			}
+			{
+				lock_guard<mutex> guard(lock);
+				decoded.push_back(image);
+			}
+			ready.notify_one();
+		});
+
+	for(int done=0;done<count;done++){
+		DecodedImage image;
+		{
+			unique_lock<mutex> guard(lock);
+			ready.wait(guard, [&]{ return !decoded.empty(); });
+			image = decoded.front();
+			decoded.pop_front();
+		}
+		const TextureRequest &request = requests[image.request];
+		TRACE_SCOPE("upload", request.filename);
+		if(image.entry){
+			*request.texture = uploadCachedTexture(*cache, *image.entry, request.base_level);
+			// Compressed levels the driver can't take: decode the PNG after all
+			if(!*request.texture)
+				*request.texture = createReducedTexture(request.filename, request.base_level);
+			continue;
+		}
+		if(!image.pixels){
+			cout << "SOIL loading error: '" << request.filename << "'" << endl;
+			*request.texture = 0;
+			continue;
+		}
+		*request.texture = uploadTexture(image.width, image.height, image.pixels);
+		SOIL_free_image_data(image.pixels);
+	}
+	jobs.wait();
+}
+
+int TextureQuality::configure (const char* tier)
+{
+	if(!strcmp(tier, "low"))
+		quality_tier = QUALITY_LOW;
+	else if(!strcmp(tier, "medium"))
+		quality_tier = QUALITY_MEDIUM;
+	else if(!strcmp(tier, "high"))
+		quality_tier = QUALITY_HIGH;
+	else
+		return 0;
+	return 1;
+}
+
+int TextureQuality::maxSide () const
+{
+	switch(quality_tier){
+		case QUALITY_LOW: return 256;
+		case QUALITY_MEDIUM: return 512;
+	}
+	return 1 << 30;
+}
+
+static unsigned readBigEndian (const unsigned char* p)
+{
+	return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+/* Dimensions from the PNG or TGA header alone, without decoding */
+static int imageSize (const char* filename, int &width, int &height)
+{
+	unsigned char header[24];
+	AssetSpan span;
+	if(findAsset(filename, span)){
+		if(span.size < sizeof(header))
+			return 0;
+		memcpy(header, span.data, sizeof(header));
+	}
+	else{
+		FILE* in = fopen(filename, "rb");
+		if(!in)
+			return 0;
+		size_t got = fread(header, 1, sizeof(header), in);
+		fclose(in);
+		if(got < sizeof(header))
+			return 0;
+	}
+	static const unsigned char png[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	if(!memcmp(header, png, 8)){
+		width = readBigEndian(header + 16);
+		height = readBigEndian(header + 20);
+		return 1;
+	}
+	size_t length = strlen(filename);
+	if(length > 4 && !strcmp(filename + length - 4, ".tga")){
+		width = header[12] | (header[13] << 8);
+		height = header[14] | (header[15] << 8);
+		return 1;
+	}
+	return 0;
+}
+
+/* Memory of an RGBA (or DXT1, 8 bytes per 4x4 block) mip chain from base on */
+static size_t chainBytes (int width, int height, int base, int compressed)
+{
+	size_t bytes = 0;
+	for(int l=0;;l++){
+		if(l >= base)
+			bytes += compressed ? (size_t)((width + 3) / 4) * ((height + 3) / 4) * 8 : (size_t)width * height * 4;
+		if(width == 1 && height == 1)
+			return bytes;
+		width = max(1, width/2);
+		height = max(1, height/2);
+	}
+}
+
+size_t planTextures (TextureRequest* requests, int count, const TextureQuality &quality, const TextureCache* cache)
+{
+	vector<int> width(count, 0), height(count, 0), compressed(count, 0);
+	for(int r=0;r<count;r++){
+		requests[r].base_level = 0;
+		const TexCacheEntry* entry = cache ? cache->find(requests[r].filename) : NULL;
+		if(entry){
+			width[r] = entry->width;
+			height[r] = entry->height;
+			compressed[r] = entry->format == TEXCACHE_DXT1 && GLAD_GL_EXT_texture_compression_s3tc;
+		}
+		else if(!imageSize(requests[r].filename, width[r], height[r]))
+			continue; // unknown size: loaded as is and left out of the estimate
+		while(max(width[r], height[r]) >> requests[r].base_level > quality.maxSide())
+			requests[r].base_level++;
+	}
+
+	size_t total = 0;
+	for(int r=0;r<count;r++)
+		if(width[r])
+			total += chainBytes(width[r], height[r], requests[r].base_level, compressed[r]);
+	// Over budget: take a level off whichever texture is biggest now
+	while(quality.budget() && total > quality.budget()){
+		int biggest = -1;
+		size_t biggest_bytes = 0;
+		for(int r=0;r<count;r++){
+			if(!width[r] || max(width[r], height[r]) >> requests[r].base_level <= 1)
+				continue;
+			size_t bytes = chainBytes(width[r], height[r], requests[r].base_level, compressed[r]);
+			if(bytes > biggest_bytes){
+				biggest = r;
+				biggest_bytes = bytes;
+			}
+		}
+		if(biggest < 0)
+			break;
+		requests[biggest].base_level++;
+		total -= biggest_bytes - chainBytes(width[biggest], height[biggest], requests[biggest].base_level, compressed[biggest]);
+	}
+	return total;
+}
+
+void remapUV (const GLfloat* uv, int count, const AtlasRect &rect, GLfloat* out)
+{
+	for(int v=0;v<count;v++){
+		out[2*v] = rect.u0 + uv[2*v] * (rect.u1 - rect.u0);
+		out[2*v+1] = rect.v0 + uv[2*v+1] * (rect.v1 - rect.v0);
+	}
+}
+
+int TextureAtlas::load (const char* filename)
+{
+	AssetSpan span;
+	ifstream file;
+	istringstream packed;
+	istream *in = &file;
+	if(findAsset(filename, span)){
+		packed.str(string((const char*)span.data, span.size));
+		in = &packed;
+	}
+	else{
+		file.open(filename);
+		if(!file.is_open())
+			return 0;
+	}
+	clear();
+	string line;
+	while(getline(*in, line)){
+		if(line.empty() || line[0] == '#')
+			continue;
+		istringstream words(line);
+		string name;
+		AtlasRect rect;
+		if(words >> name >> rect.u0 >> rect.v0 >> rect.u1 >> rect.v1){
+			names.push_back(name);
+			rects.push_back(rect);
+		}
+	}
+	return 1;
+}
+
+const AtlasRect* TextureAtlas::find (const char* name) const
+{
+	for(int r=0;r<names.size();r++)
+		if(names[r] == name)
+			return &rects[r];
+	return NULL;
+}
+
+AtlasImage TextureAtlas::image (const char* name, int atlas, int fallback) const
+{
+	AtlasImage image = { fallback, { 0, 0, 1, 1 } };
+	const AtlasRect* rect = find(name);
+	if(rect){
+		image.texture = atlas;
+		image.rect = *rect;
+	}
+	return image;
+}
@@ -0,0 +1,97 @@
+#ifndef TEXTURES_H
+#define TEXTURES_H
+
+#include <glad/glad.h>
+#include <string>
+#include <vector>
+
+#include "texcache.h"
+
+class JobSystem;
+
+/* Written by tools/texbake (make bake) */
+#define TEXTURE_CACHE "images/textures.cache"
+/* Written by tools/atlaspack (make atlas) */
+#define ATLAS_IMAGE "images/atlas.tga"
+#define ATLAS_TABLE "images/atlas.txt"
+
+/* Create an OpenGL Texture from an image */
+GLuint createTexture (const char* filename);
+/* Create an OpenGL Texture from decoded RGBA pixels */
+GLuint uploadTexture (int width, int height, const unsigned char* pixels);
+/* Upload a baked mip chain from the cache, starting at level base.
+   Returns 0 if the driver can't take its format. */
+GLuint uploadCachedTexture (const TextureCache &cache, const TexCacheEntry &entry, int base = 0);
+
+/* One image file to load into *texture */
+struct TextureRequest {
+	const char* filename;
+	GLuint* texture;
+	int base_level; // mip level of the source that becomes level 0, set by planTextures
+};
+
+/* Quality tiers: the largest texture side they load */
+#define QUALITY_LOW 0 // 256
+#define QUALITY_MEDIUM 1 // 512
+#define QUALITY_HIGH 2 // full resolution
+
+class TextureQuality {
+	public:
+		TextureQuality() : quality_tier(QUALITY_HIGH), budget_bytes(0) {}
+
+		/* Parse "low", "medium" or "high". Returns 0 on a bad tier. */
+		int configure(const char* tier);
+		/* Most texture memory to use, 0 for no limit */
+		void setBudget(size_t bytes) { budget_bytes = bytes; }
+
+		int tier() const { return quality_tier; }
+		int maxSide() const;
+		size_t budget() const { return budget_bytes; }
+
+	private:
+		int quality_tier;
+		size_t budget_bytes;
+};
+
+/* Pick each request's base level: every image is cut down to the tier's
+   largest side, then the biggest ones drop further levels until the
+   estimated total fits the budget. Returns the estimated bytes. */
+size_t planTextures (TextureRequest* requests, int count, const TextureQuality &quality, const TextureCache* cache = NULL);
+
+/* Decode all images on the job system's workers and upload each one on the
+   calling thread, which must own the GL context, as soon as it is decoded.
+   Images whose baked entry in cache still matches the file skip decoding. */
+void loadTextures (JobSystem &jobs, const TextureRequest* requests, int count, const TextureCache* cache = NULL);
+
+/* Part of a texture in texture coordinates */
+struct AtlasRect {
+	float u0, v0, u1, v1;
+};
+
+/* What a mesh samples: a whole texture, or one rect of the atlas.
+   texture is whatever the caller names textures by, e.g. an asset id. */
+struct AtlasImage {
+	int texture;
+	AtlasRect rect;
+};
+
+/* Map count UVs given for a whole image into rect */
+void remapUV (const GLfloat* uv, int count, const AtlasRect &rect, GLfloat* out);
+
+/* UV table of the atlas */
+class TextureAtlas {
+	public:
+		/* Read the table. Returns 0 if it is missing. */
+		int load (const char* filename);
+		void clear () { names.clear(); rects.clear(); }
+		const AtlasRect* find (const char* name) const;
+
+		/* Rect of name in texture atlas if it is packed, else all of fallback */
+		AtlasImage image (const char* name, int atlas, int fallback) const;
+
+	private:
+		std::vector<std::string> names;
+		std::vector<AtlasRect> rects;
+};
+
+#endif
@@ -0,0 +1,160 @@
+/* Build-time texture atlas packing.
+ * Scales every image given on the command line down to at most -m pixels on
+ * its longer side, packs them in shelves into one power of two RGBA image
+ * and writes it as TGA together with a table of UV rects, one line per image:
+ *   <image> <u0> <v0> <u1> <v1>
+ *
+ *   atlaspack [-m maxside] [-o images/atlas] image.png...
+ * writes images/atlas.tga and images/atlas.txt
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <SOIL/SOIL.h>
+
+using namespace std;
+
+// Border of repeated edge texels around every image, so filtering and the
+// first few mip levels don't pull in the neighbours
+#define GUTTER 4
+
+struct Image {
+	const char *name;
+	int w, h;
+	vector<unsigned char> pixels;
+	int x, y; // placement in the atlas
+};
+
+static void usage()
+{
+	fprintf(stderr, "usage: atlaspack [-m maxside] [-o outprefix] image.png...\n");
+	exit(EXIT_FAILURE);
+}
+
+/* Area average resampling to w x h */
+static void shrink(const unsigned char *src, int sw, int sh, Image &img)
+{
+	img.pixels.resize((size_t)img.w * img.h * 4);
+	for(int y=0;y<img.h;y++){
+		int y0 = (long long)y * sh / img.h, y1 = max(y0 + 1, (int)((long long)(y+1) * sh / img.h));
+		for(int x=0;x<img.w;x++){
+			int x0 = (long long)x * sw / img.w, x1 = max(x0 + 1, (int)((long long)(x+1) * sw / img.w));
+			unsigned sum[4] = {0, 0, 0, 0};
+			for(int sy=y0;sy<y1;sy++)
+				for(int sx=x0;sx<x1;sx++)
+					for(int c=0;c<4;c++)
+						sum[c] += src[((size_t)sy*sw + sx)*4 + c];
+			unsigned n = (y1 - y0) * (x1 - x0);
+			for(int c=0;c<4;c++)
+				img.pixels[((size_t)y*img.w + x)*4 + c] = (sum[c] + n/2) / n;
+		}
+	}
+}
+
+static bool taller(const Image *a, const Image *b)
+{
+	return a->h > b->h;
+}
+
+/* Shelf packing into a size wide atlas. Returns the height used, or -1 if
+   an image doesn't fit or the result would be taller than size. */
+static int pack(vector<Image*> &order, int size)
+{
+	int x = 0, y = 0, shelf = 0;
+	for(int i=0;i<order.size();i++){
+		Image &img = *order[i];
+		int w = img.w + 2*GUTTER, h = img.h + 2*GUTTER;
+		if(w > size)
+			return -1;
+		if(x + w > size){
+			y += shelf;
+			x = shelf = 0;
+		}
+		img.x = x + GUTTER;
+		img.y = y + GUTTER;
+		x += w;
+		shelf = max(shelf, h);
+	}
+	return y + shelf <= size ? y + shelf : -1;
+}
+
+int main(int argc, char **argv)
+{
+	int maxside = 512;
+	string prefix = "images/atlas";
+	vector<Image> images;
+	for(int i=1;i<argc;i++){
+		if(!strcmp(argv[i], "-m") && i+1 < argc)
+			maxside = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "-o") && i+1 < argc)
+			prefix = argv[++i];
+		else if(argv[i][0] == '-')
+			usage();
+		else{
+			images.push_back(Image());
+			images.back().name = argv[i];
+		}
+	}
+	if(images.empty() || maxside <= 0)
+		usage();
+
+	for(int i=0;i<images.size();i++){
+		Image &img = images[i];
+		int w, h;
+		unsigned char *data = SOIL_load_image(img.name, &w, &h, 0, SOIL_LOAD_RGBA);
+		if(!data){
+			fprintf(stderr, "Unable to load %s\n", img.name);
+			return EXIT_FAILURE;
+		}
+		float scale = min(1.0f, (float)maxside / max(w, h));
+		img.w = max(1, (int)(w * scale + 0.5f));
+		img.h = max(1, (int)(h * scale + 0.5f));
+		shrink(data, w, h, img);
+		SOIL_free_image_data(data);
+	}
+
+	vector<Image*> order;
+	for(int i=0;i<images.size();i++)
+		order.push_back(&images[i]);
+	stable_sort(order.begin(), order.end(), taller);
+	int size = 64, used;
+	while((used = pack(order, size)) < 0)
+		size *= 2;
+	int height = 1;
+	while(height < used)
+		height *= 2;
+
+	vector<unsigned char> atlas((size_t)size * height * 4, 0);
+	for(int i=0;i<images.size();i++){
+		const Image &img = images[i];
+		for(int y=-GUTTER;y<img.h+GUTTER;y++)
+			for(int x=-GUTTER;x<img.w+GUTTER;x++){
+				int sx = min(max(x, 0), img.w-1), sy = min(max(y, 0), img.h-1);
+				memcpy(&atlas[((size_t)(img.y + y)*size + img.x + x)*4], &img.pixels[((size_t)sy*img.w + sx)*4], 4);
+			}
+	}
+
+	string image_file = prefix + ".tga", table_file = prefix + ".txt";
+	if(!SOIL_save_image(image_file.c_str(), SOIL_SAVE_TYPE_TGA, size, height, 4, &atlas[0])){
+		fprintf(stderr, "Unable to write %s\n", image_file.c_str());
+		return EXIT_FAILURE;
+	}
+	FILE *table = fopen(table_file.c_str(), "w");
+	if(!table){
+		fprintf(stderr, "Unable to write %s\n", table_file.c_str());
+		return EXIT_FAILURE;
+	}
+	fprintf(table, "# %s %dx%d\n", image_file.c_str(), size, height);
+	for(int i=0;i<images.size();i++){
+		const Image &img = images[i];
+		fprintf(table, "%s %.6f %.6f %.6f %.6f\n", img.name, (float)img.x / size, (float)img.y / height,
+				(float)(img.x + img.w) / size, (float)(img.y + img.h) / height);
+	}
+	fclose(table);
+	printf("%s: %d images in %dx%d\n", image_file.c_str(), (int)images.size(), size, height);
+	return EXIT_SUCCESS;
+}
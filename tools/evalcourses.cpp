@@ -0,0 +1,96 @@
+/* Headless course evaluation.
+ * Plays every course given on the command line with the same input script,
+ * many copies at a time, and reports how each playthrough ended.
+ *
+ *   evalcourses [-j threads] [-t ticks] [-n copies] [-s script] course.txt...
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <vector>
+
+#include "course.h"
+#include "runner.h"
+#include "jobsystem.h"
+
+using namespace std;
+
+static void usage()
+{
+	fprintf(stderr, "usage: evalcourses [-j threads] [-t ticks] [-n copies] [-s script] course.txt...\n");
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+	int threads = 0, ticks = 3600, copies = 1;
+	const char *script_file = NULL;
+	vector<const char*> files;
+	for(int i=1;i<argc;i++){
+		if(!strcmp(argv[i], "-j") && i+1 < argc)
+			threads = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "-t") && i+1 < argc)
+			ticks = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "-n") && i+1 < argc)
+			copies = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "-s") && i+1 < argc)
+			script_file = argv[++i];
+		else if(argv[i][0] == '-')
+			usage();
+		else
+			files.push_back(argv[i]);
+	}
+	if(files.empty() || ticks <= 0 || copies <= 0)
+		usage();
+
+	vector<Course> courses(files.size());
+	for(int f=0;f<files.size();f++)
+		if(!loadCourse(courses[f], files[f])){
+			fprintf(stderr, "Unable to open %s\n", files[f]);
+			return EXIT_FAILURE;
+		}
+	InputScript script;
+	vector<const InputScript*> scripts;
+	if(script_file){
+		if(!loadScript(script, script_file)){
+			fprintf(stderr, "Unable to open %s\n", script_file);
+			return EXIT_FAILURE;
+		}
+		scripts.push_back(&script);
+	}
+
+	vector<const Course*> instances;
+	for(int c=0;c<copies;c++)
+		for(int f=0;f<courses.size();f++)
+			instances.push_back(&courses[f]);
+
+	JobSystem jobs(threads);
+	BatchRunner runner(jobs);
+	runner.start(instances, scripts);
+	vector<InstanceFrame> frames((size_t)ticks * instances.size());
+
+	chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+	runner.run(ticks, frames.data());
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+
+	const InstanceFrame *last = &frames[(size_t)(ticks - 1) * instances.size()];
+	for(int f=0;f<files.size();f++){
+		int done = 0;
+		long finish_sum = 0;
+		int treasure_left = 0;
+		for(int c=0;c<copies;c++){
+			const InstanceFrame &frame = last[c * files.size() + f];
+			if(frame.finished >= 0)
+				done++, finish_sum += frame.finished;
+			treasure_left += frame.treasure_left;
+		}
+		printf("%s: finished %d/%d", files[f], done, copies);
+		if(done)
+			printf(", mean finish tick %.1f", (double)finish_sum / done);
+		printf(", mean treasure left %.2f\n", (double)treasure_left / copies);
+	}
+	printf("%d playthroughs x %d ticks on %d threads in %.3f s (%.1f playthroughs/s)\n",
+			(int)instances.size(), ticks, jobs.threadCount(), seconds, instances.size() / seconds);
+	return 0;
+}
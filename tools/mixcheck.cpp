@@ -0,0 +1,164 @@
+/* Headless check of the effect mixer and the sinks that need no device.
+ * Mixes a known tone through Mixer exactly as the audio thread does,
+ * compares every sample with the gains worked out by hand, writes the
+ * result through the wav:fast sink and reads the file back. Then mixes a
+ * full set of voices into the null:fast sink and reports the cost per
+ * block against the time the block lasts. Exits non-zero on a mismatch.
+ *
+ *   mixcheck [-b blocks] [out.wav]
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "audio.h"
+#include "audiosink.h"
+#include "mixer.h"
+
+using namespace std;
+
+#define TONE_HZ 441
+#define TONE_SECONDS 0.25f
+#define TONE_GAIN 0.8f
+#define TONE_PAN 0.5f
+
+static void usage()
+{
+	fprintf(stderr, "usage: mixcheck [-b blocks] [out.wav]\n");
+	exit(EXIT_FAILURE);
+}
+
+static vector<float> tone(float seconds, float hz, float amplitude)
+{
+	vector<float> samples((int)(seconds * AUDIO_RATE));
+	for(int i=0;i<samples.size();i++)
+		samples[i] = amplitude * sinf(2 * (float)M_PI * hz * i / AUDIO_RATE);
+	return samples;
+}
+
+/* Mix the tone a block at a time into out, as 16-bit frames. Returns the
+   number of samples that differ from the reference by more than one step. */
+static int mixTone(Mixer &mixer, int sound, vector<short> &out)
+{
+	const vector<float> &samples = mixer.sound(sound);
+	int blocks = (samples.size() + AUDIO_BLOCK - 1) / AUDIO_BLOCK + 1;
+	out.assign(blocks * AUDIO_BLOCK * AUDIO_CHANNELS, 0);
+	mixer.play(sound, TONE_GAIN, TONE_PAN);
+	float block[AUDIO_BLOCK * AUDIO_CHANNELS];
+	for(int b=0;b<blocks;b++){
+		memset(block, 0, sizeof(block));
+		mixer.mix(block, AUDIO_BLOCK);
+		floatToPcm(&out[b * AUDIO_BLOCK * AUDIO_CHANNELS], block, AUDIO_BLOCK * AUDIO_CHANNELS);
+	}
+
+	// Constant power pan, the tone is silent after its end
+	float angle = (TONE_PAN + 1) * (float)M_PI / 4;
+	float gains[AUDIO_CHANNELS] = { TONE_GAIN * cosf(angle), TONE_GAIN * sinf(angle) };
+	int wrong = 0;
+	for(int i=0;i<out.size() / AUDIO_CHANNELS;i++)
+		for(int c=0;c<AUDIO_CHANNELS;c++){
+			float expected = i < samples.size() ? samples[i] * gains[c] * 32768 : 0;
+			expected = max(-32768.0f, min(32767.0f, expected));
+			if(fabsf(out[i*AUDIO_CHANNELS + c] - expected) > 1)
+				wrong++;
+		}
+	return wrong;
+}
+
+/* Read back what the wav sink wrote and compare it with frames */
+static int checkWav(const char *path, const vector<short> &frames)
+{
+	FILE *in = fopen(path, "rb");
+	if(!in){
+		fprintf(stderr, "Unable to read %s\n", path);
+		return 0;
+	}
+	unsigned char header[44];
+	vector<short> data(frames.size());
+	int ok = fread(header, sizeof(header), 1, in) == 1 && fread(&data[0], sizeof(short), data.size(), in) == data.size();
+	ok = ok && fgetc(in) == EOF;
+	fclose(in);
+	if(!ok){
+		fprintf(stderr, "%s: wrong length\n", path);
+		return 0;
+	}
+	unsigned channels = header[22] | header[23] << 8, data_size;
+	unsigned rate;
+	memcpy(&rate, header + 24, 4);
+	memcpy(&data_size, header + 40, 4);
+	if(memcmp(header, "RIFF", 4) || memcmp(header + 8, "WAVEfmt ", 8) || memcmp(header + 36, "data", 4) ||
+			channels != AUDIO_CHANNELS || rate != AUDIO_RATE || data_size != frames.size() * sizeof(short)){
+		fprintf(stderr, "%s: bad header\n", path);
+		return 0;
+	}
+	if(data != frames){
+		fprintf(stderr, "%s: samples differ from the mix\n", path);
+		return 0;
+	}
+	return 1;
+}
+
+int main(int argc, char **argv)
+{
+	int blocks = 2000;
+	const char *path = "mixcheck.wav";
+	for(int i=1;i<argc;i++){
+		if(!strcmp(argv[i], "-b") && i+1 < argc)
+			blocks = atoi(argv[++i]);
+		else if(argv[i][0] == '-')
+			usage();
+		else
+			path = argv[i];
+	}
+	if(blocks <= 0)
+		usage();
+
+	Mixer mixer;
+	int sound = mixer.addSound(tone(TONE_SECONDS, TONE_HZ, 0.5f));
+	vector<short> frames;
+	int wrong = mixTone(mixer, sound, frames);
+	printf("mix: %d of %d samples off by more than one step\n", wrong, (int)frames.size());
+
+	string spec = string("wav:fast:") + path;
+	AudioSink wav;
+	if(!wav.configure(spec.c_str()) || !wav.open(AUDIO_RATE, AUDIO_CHANNELS)){
+		fprintf(stderr, "Unable to open %s\n", path);
+		return EXIT_FAILURE;
+	}
+	for(int f=0;f<frames.size();f+=AUDIO_BLOCK * AUDIO_CHANNELS)
+		wav.write(&frames[f], AUDIO_BLOCK);
+	wav.close();
+	int written = checkWav(path, frames);
+	printf("wav: %llu frames written to %s, %s\n", wav.framesWritten(), path, written ? "read back intact" : "MISMATCH");
+
+	// Every voice busy on a long loop, restarted as they end, like a busy level
+	Mixer busy;
+	int loop = busy.addSound(tone(1, TONE_HZ, 0.01f));
+	AudioSink null;
+	null.configure("null:fast");
+	null.open(AUDIO_RATE, AUDIO_CHANNELS);
+	float block[AUDIO_BLOCK * AUDIO_CHANNELS];
+	short pcm[AUDIO_BLOCK * AUDIO_CHANNELS];
+	long long usec = 0;
+	for(int b=0;b<blocks;b++){
+		for(int v=busy.activeVoices();v<MIXER_VOICES;v++)
+			busy.play(loop, 1, (v % 9 - 4) / 4.0f);
+		chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+		memset(block, 0, sizeof(block));
+		busy.mix(block, AUDIO_BLOCK);
+		floatToPcm(pcm, block, AUDIO_BLOCK * AUDIO_CHANNELS);
+		usec += chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - begin).count();
+		null.write(pcm, AUDIO_BLOCK);
+	}
+	null.close();
+	double block_usec = AUDIO_BLOCK * 1e6 / AUDIO_RATE;
+	printf("null: %d blocks of %d voices, mix %.1f us/block (%.2f%% of %.0f us)\n",
+			blocks, MIXER_VOICES, (double)usec / blocks, 100 * usec / blocks / block_usec, block_usec);
+
+	return !wrong && written ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,121 @@
+/* Asset pack building.
+ * Bundles every file given on the command line into one pack, stored
+ * under the path as given, so run it from the directory the game runs in.
+ * -v checks every entry of an existing pack against its hash instead.
+ *
+ *   packbuild [-o adventura.pak] file...
+ *   packbuild -v adventura.pak
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "pack.h"
+#include "texcache.h"
+
+using namespace std;
+
+static void usage()
+{
+	fprintf(stderr, "usage: packbuild [-o packfile] file...\n       packbuild -v packfile\n");
+	exit(EXIT_FAILURE);
+}
+
+static int readFile(const char *filename, vector<unsigned char> &contents)
+{
+	FILE *in = fopen(filename, "rb");
+	if(!in)
+		return 0;
+	unsigned char buffer[65536];
+	size_t got;
+	contents.clear();
+	while((got = fread(buffer, 1, sizeof(buffer), in)) > 0)
+		contents.insert(contents.end(), buffer, buffer + got);
+	fclose(in);
+	return 1;
+}
+
+static size_t align(size_t offset)
+{
+	return (offset + PACK_ALIGN - 1) & ~(size_t)(PACK_ALIGN - 1);
+}
+
+static int verifyPack(const char *filename)
+{
+	AssetPack pack;
+	if(!pack.open(filename)){
+		fprintf(stderr, "%s is not a pack\n", filename);
+		return EXIT_FAILURE;
+	}
+	int bad = 0;
+	for(int e=0;e<pack.size();e++)
+		if(!pack.verify(pack.entry(e))){
+			printf("%s: hash mismatch\n", pack.entry(e).name);
+			bad++;
+		}
+	printf("%s: %d entries, %d bad\n", filename, pack.size(), bad);
+	return bad ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int main(int argc, char **argv)
+{
+	const char *output = ASSET_PACK;
+	vector<const char*> files;
+	for(int i=1;i<argc;i++){
+		if(!strcmp(argv[i], "-v") && i+1 < argc)
+			return verifyPack(argv[i+1]);
+		else if(!strcmp(argv[i], "-o") && i+1 < argc)
+			output = argv[++i];
+		else if(argv[i][0] == '-')
+			usage();
+		else
+			files.push_back(argv[i]);
+	}
+	if(files.empty())
+		usage();
+
+	vector<PackEntry> entries(files.size());
+	vector<vector<unsigned char> > contents(files.size());
+	size_t offset = align(sizeof(PackHeader) + files.size() * sizeof(PackEntry));
+	for(int f=0;f<files.size();f++){
+		PackEntry &entry = entries[f];
+		memset(&entry, 0, sizeof(entry));
+		if(strlen(files[f]) >= PACK_NAME){
+			fprintf(stderr, "Name too long: %s\n", files[f]);
+			return EXIT_FAILURE;
+		}
+		if(!readFile(files[f], contents[f])){
+			fprintf(stderr, "Unable to read %s\n", files[f]);
+			return EXIT_FAILURE;
+		}
+		strcpy(entry.name, files[f]);
+		entry.offset = offset;
+		entry.size = contents[f].size();
+		entry.hash = hashBytes(contents[f].empty() ? NULL : &contents[f][0], contents[f].size());
+		offset = align(offset + entry.size);
+	}
+
+	FILE *out = fopen(output, "wb");
+	if(!out){
+		fprintf(stderr, "Unable to write %s\n", output);
+		return EXIT_FAILURE;
+	}
+	PackHeader header = { PACK_MAGIC, PACK_VERSION, (unsigned)entries.size(), 0 };
+	fwrite(&header, sizeof(header), 1, out);
+	fwrite(&entries[0], sizeof(PackEntry), entries.size(), out);
+	size_t written = sizeof(header) + entries.size() * sizeof(PackEntry);
+	static const unsigned char zero[PACK_ALIGN] = {0};
+	for(int f=0;f<files.size();f++){
+		fwrite(zero, 1, entries[f].offset - written, out);
+		if(!contents[f].empty())
+			fwrite(&contents[f][0], 1, contents[f].size(), out);
+		written = entries[f].offset + entries[f].size;
+	}
+	if(fclose(out)){
+		fprintf(stderr, "Unable to write %s\n", output);
+		return EXIT_FAILURE;
+	}
+	printf("%s: %d files, %lu bytes\n", output, (int)entries.size(), (unsigned long)written);
+	return EXIT_SUCCESS;
+}
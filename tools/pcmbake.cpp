@@ -0,0 +1,94 @@
+/* Offline music decoding.
+ * Decodes each track given on the command line into the format the game
+ * plays and writes it next to the track as <track>.pcm, which the game
+ * maps and plays instead of decoding the track itself.
+ *
+ *   pcmbake game.mp3
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <mpg123.h>
+
+#include "audio.h"
+#include "pcmcache.h"
+#include "texcache.h"
+
+using namespace std;
+
+static void usage()
+{
+	fprintf(stderr, "usage: pcmbake track.mp3...\n");
+	exit(EXIT_FAILURE);
+}
+
+static int bake(const char *track)
+{
+	PcmCacheHeader header = { PCMCACHE_MAGIC, PCMCACHE_VERSION, AUDIO_RATE, AUDIO_CHANNELS, 0, 0 };
+	if(!hashFile(track, header.hash)){
+		fprintf(stderr, "Unable to read %s\n", track);
+		return 0;
+	}
+	int err;
+	mpg123_handle *mh = mpg123_new(NULL, &err);
+	if(!mh){
+		fprintf(stderr, "Unable to decode %s: %s\n", track, mpg123_plain_strerror(err));
+		return 0;
+	}
+	mpg123_format_none(mh);
+	mpg123_format(mh, AUDIO_RATE, MPG123_STEREO, MPG123_ENC_SIGNED_16);
+	if(mpg123_open(mh, track) != MPG123_OK){
+		fprintf(stderr, "Unable to decode %s: %s\n", track, mpg123_strerror(mh));
+		mpg123_delete(mh);
+		return 0;
+	}
+
+	string output = string(track) + PCMCACHE_SUFFIX, temp = output + ".tmp";
+	FILE *out = fopen(temp.c_str(), "wb");
+	if(!out){
+		fprintf(stderr, "Unable to write %s\n", temp.c_str());
+		mpg123_delete(mh);
+		return 0;
+	}
+	// Header goes in again once the length is known
+	fwrite(&header, sizeof(header), 1, out);
+	vector<unsigned char> buffer(mpg123_outblock(mh));
+	size_t done;
+	do{
+		err = mpg123_read(mh, &buffer[0], buffer.size(), &done);
+		fwrite(&buffer[0], 1, done, out);
+		header.frames += done / (AUDIO_CHANNELS * sizeof(short));
+	} while(err == MPG123_OK || err == MPG123_NEW_FORMAT);
+	mpg123_close(mh);
+	mpg123_delete(mh);
+
+	int ok = err == MPG123_DONE;
+	ok = ok && !fseek(out, 0, SEEK_SET) && fwrite(&header, sizeof(header), 1, out) == 1;
+	ok = !fclose(out) && ok;
+	if(!ok || rename(temp.c_str(), output.c_str())){
+		fprintf(stderr, "Unable to decode %s\n", track);
+		remove(temp.c_str());
+		return 0;
+	}
+	printf("%s: %llu frames, %.1f s, %llu bytes\n", output.c_str(), header.frames, (double)header.frames / AUDIO_RATE,
+			(unsigned long long)(sizeof(header) + header.frames * AUDIO_CHANNELS * sizeof(short)));
+	return 1;
+}
+
+int main(int argc, char **argv)
+{
+	if(argc < 2)
+		usage();
+	mpg123_init();
+	int ok = 1;
+	for(int i=1;i<argc;i++){
+		if(argv[i][0] == '-')
+			usage();
+		ok = bake(argv[i]) && ok;
+	}
+	mpg123_exit();
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
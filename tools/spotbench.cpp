@@ -0,0 +1,383 @@
+/* Spotlight shading benchmark.
+ * Renders a course offscreen from the adventurer's view at the start cell,
+ * turning a little every frame, once with each way of lighting it, and
+ * reports the time per frame. Meant for software rasterizers such as
+ * llvmpipe, where the fragment stage is most of the frame:
+ *
+ *   LIBGL_ALWAYS_SOFTWARE=1 spotbench [-f frames] [-s WxH] [course.txt]
+ *
+ * "acos" is the level 2 flashlight as it was before the cosine cutoff and
+ * is only kept here as the reference; "unlit" is level 1's variant, the
+ * cost of everything but the lighting. The last column is how many pixels
+ * of the first frame differ from the acos rendering.
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+#include <glm/gtx/transform.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "course.h"
+#include "agent.h"
+#include "shaders.h"
+
+using namespace std;
+
+#define SPOT_ANGLE 25.0f
+#define SPOT_SOFTNESS 5.0f
+
+/* TextureRender.frag's flashlight before it compared cosines */
+static const char *acos_fragment =
+	"#version 330 core\n"
+	"in vec2 fragTexCoord;\n"
+	"in vec3 objectPositionout;\n"
+	"out vec4 colorout;\n"
+	"uniform sampler2D texSampler;\n"
+	"uniform vec3 playerPosition;\n"
+	"uniform float playerAngle;\n"
+	"void main()\n"
+	"{\n"
+	"    vec3 playerDirection = vec3(10*sin((3.14/180)*playerAngle),0,-10*cos((3.14/180)*playerAngle));\n"
+	"    vec3 vertexDirection = objectPositionout-playerPosition;\n"
+	"    float angle = acos(dot(playerDirection,vertexDirection)/(length(playerDirection)*length(vertexDirection))) *(180/3.14);\n"
+	"    vec4 xyz = texture( texSampler, fragTexCoord ).rgba;\n"
+	"    vec3 color=xyz.xyz;\n"
+	"    float dist = length(objectPositionout - playerPosition);\n"
+	"    if(angle<=25)\n"
+	"        color = color * (1.0/dist) * 10.0;\n"
+	"    else\n"
+	"        color = color * (1.0/dist) * 3.0;\n"
+	"    colorout = vec4(color,xyz.a);\n"
+	"}\n";
+
+struct Variant {
+	const char *name;
+	const char *defines; // NULL: acos_fragment instead of TextureRender.frag
+	float softness;
+	GLuint program;
+	vector<double> msec;
+	long long differing;
+
+	Variant(const char *name, const char *defines, float softness) :
+		name(name), defines(defines), softness(softness), program(0), differing(0) {}
+};
+
+/* One draw of the course: a mesh placed by model, lit around position */
+struct Object {
+	int mesh;
+	glm::mat4 model;
+	glm::vec3 position;
+};
+
+struct Mesh {
+	GLuint vao, buffers[2];
+	int vertices;
+};
+
+static void usage()
+{
+	fprintf(stderr, "usage: spotbench [-f frames] [-s WxH] [course.txt]\n");
+	exit(EXIT_FAILURE);
+}
+
+static int readFile(const char *filename, string &text)
+{
+	ifstream in(filename, ios::binary);
+	if(!in.is_open())
+		return 0;
+	stringstream contents;
+	contents << in.rdbuf();
+	text = contents.str();
+	return 1;
+}
+
+static Mesh createMesh(const vector<GLfloat> &positions, const vector<GLfloat> &uvs)
+{
+	Mesh mesh;
+	mesh.vertices = positions.size() / 3;
+	glGenVertexArrays(1, &mesh.vao);
+	glBindVertexArray(mesh.vao);
+	glGenBuffers(2, mesh.buffers);
+	glBindBuffer(GL_ARRAY_BUFFER, mesh.buffers[0]);
+	glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(GLfloat), &positions[0], GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+	glEnableVertexAttribArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, mesh.buffers[1]);
+	glBufferData(GL_ARRAY_BUFFER, uvs.size() * sizeof(GLfloat), &uvs[0], GL_STATIC_DRAW);
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, 0);
+	glEnableVertexAttribArray(2);
+	return mesh;
+}
+
+/* Quads given by four corners each, as two triangles */
+static Mesh createQuads(const float (*corners)[4][3], int count)
+{
+	static const float corner_uv[4][2] = { {0, 0}, {0, 1}, {1, 1}, {1, 0} };
+	static const int order[6] = { 0, 1, 2, 0, 2, 3 };
+	vector<GLfloat> positions, uvs;
+	for(int q=0;q<count;q++)
+		for(int v=0;v<6;v++){
+			positions.insert(positions.end(), corners[q][order[v]], corners[q][order[v]] + 3);
+			uvs.insert(uvs.end(), corner_uv[order[v]], corner_uv[order[v]] + 2);
+		}
+	return createMesh(positions, uvs);
+}
+
+/* The game's block: five faces of a 20 unit cube, no bottom */
+static Mesh createBlock()
+{
+	static const float faces[5][4][3] = {
+		{ {-10, 10, 10}, {-10, -10, 10}, {10, -10, 10}, {10, 10, 10} },
+		{ {10, 10, -10}, {10, -10, -10}, {-10, -10, -10}, {-10, 10, -10} },
+		{ {10, 10, 10}, {10, -10, 10}, {10, -10, -10}, {10, 10, -10} },
+		{ {-10, 10, -10}, {-10, -10, -10}, {-10, -10, 10}, {-10, 10, 10} },
+		{ {-10, 10, -10}, {-10, 10, 10}, {10, 10, 10}, {10, 10, -10} },
+	};
+	return createQuads(faces, 5);
+}
+
+/* The inside of the game's skybox */
+static Mesh createSky()
+{
+	const float x = 300, y = 250, z = 300;
+	const float faces[6][4][3] = {
+		{ {-x, y, -z}, {-x, -y, -z}, {x, -y, -z}, {x, y, -z} },
+		{ {x, y, z}, {x, -y, z}, {-x, -y, z}, {-x, y, z} },
+		{ {-x, y, z}, {-x, -y, z}, {-x, -y, -z}, {-x, y, -z} },
+		{ {x, y, -z}, {x, -y, -z}, {x, -y, z}, {x, y, z} },
+		{ {-x, y, z}, {-x, y, -z}, {x, y, -z}, {x, y, z} },
+		{ {-x, -y, -z}, {-x, -y, z}, {x, -y, z}, {x, -y, -z} },
+	};
+	return createQuads(faces, 6);
+}
+
+/* Mipmapped checkerboard with some noise, so texturing costs what it does in the game */
+static GLuint createTexture()
+{
+	const int side = 256;
+	vector<unsigned char> pixels(side * side * 4);
+	unsigned seed = 1;
+	for(int y=0;y<side;y++)
+		for(int x=0;x<side;x++){
+			seed = seed * 1103515245 + 12345;
+			unsigned char shade = (((x >> 5) ^ (y >> 5)) & 1 ? 200 : 90) + (seed >> 27);
+			unsigned char *p = &pixels[(y * side + x) * 4];
+			p[0] = shade, p[1] = shade * 3 / 4, p[2] = shade / 2, p[3] = 255;
+		}
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, side, side, 0, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
+	glGenerateMipmap(GL_TEXTURE_2D);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	return texture;
+}
+
+/* Everything draw() puts on the course, placed the same way */
+static void courseObjects(const Course &course, vector<Object> &objects)
+{
+	const int BLOCK = 0, SKY = 1;
+	// createBackground() leaves skyposy at 80, which draw() then lights the sky with
+	Object sky = { SKY, glm::mat4(1.0f), glm::vec3(300, 80, 300) };
+	objects.push_back(sky);
+	for(int i=0;i<course.nhor;i++)
+		for(int j=0;j<course.nvert;j++){
+			char cell = course.gamemat[i][j];
+			if(cell != '.' && cell != 'B' && cell != 'T')
+				continue;
+			glm::vec3 position(course.cellX(j), 0.1, course.cellZ(i));
+			Object floor = { BLOCK, glm::translate(position) * glm::scale(glm::vec3(1,10,1)) * glm::translate(glm::vec3(0,-10,0)), position };
+			objects.push_back(floor);
+		}
+	for(int p=0;p<course.blocks.size();p++){
+		glm::vec3 position(course.cellX(course.blocks[p].second), 10, course.cellZ(course.blocks[p].first));
+		Object block = { BLOCK, glm::translate(position) * glm::scale(glm::vec3(0.8,0.8,0.8)), position };
+		objects.push_back(block);
+	}
+	for(int p=0;p<course.imblocks.size();p++){
+		glm::vec3 position(course.cellX(course.imblocks[p].second), course.impos[p].first, course.cellZ(course.imblocks[p].first));
+		Object block = { BLOCK, glm::translate(position) * glm::translate(glm::vec3(0,-10,0)), position };
+		objects.push_back(block);
+	}
+}
+
+static void drawFrame(const Variant &variant, const vector<Object> &objects, const Mesh *meshes,
+		const Agent &player, float angle, float aspect)
+{
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	float radians = angle * M_PI/180.0f;
+	// The adventurer view of the game
+	glm::mat4 VP = glm::perspective(70.0f, aspect, 0.1f, 600.0f) * glm::lookAt(
+			glm::vec3(player.posx + 10 * sin(radians), player.posy, player.posz - 10 * cos(radians)),
+			glm::vec3(player.posx + 100 * sin(radians), 0, player.posz - 100 * cos(radians)),
+			glm::vec3(0,1,0));
+	GLuint program = variant.program;
+	glUseProgram(program);
+	glUniform1i(glGetUniformLocation(program, "texSampler"), 0);
+	glUniform3f(glGetUniformLocation(program, "playerPosition"), player.posx, player.posy, player.posz);
+	glUniform1f(glGetUniformLocation(program, "playerAngle"), angle);
+	glUniform3f(glGetUniformLocation(program, "spotDirection"), sin(radians), 0, -cos(radians));
+	glUniform1f(glGetUniformLocation(program, "spotCutoff"), cos((SPOT_ANGLE + variant.softness)*M_PI/180.0f));
+	glUniform1f(glGetUniformLocation(program, "spotInner"), cos((SPOT_ANGLE - variant.softness)*M_PI/180.0f));
+	GLint mvp = glGetUniformLocation(program, "MVP"), position = glGetUniformLocation(program, "objectPosition");
+	for(int o=0;o<objects.size();o++){
+		glm::mat4 MVP = VP * objects[o].model;
+		glUniformMatrix4fv(mvp, 1, GL_FALSE, &MVP[0][0]);
+		glUniform3f(position, objects[o].position.x, objects[o].position.y, objects[o].position.z);
+		const Mesh &mesh = meshes[objects[o].mesh];
+		glBindVertexArray(mesh.vao);
+		glDrawArrays(GL_TRIANGLES, 0, mesh.vertices);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	int frames = 120, width = 1200, height = 600;
+	const char *course_file = "2.txt";
+	for(int i=1;i<argc;i++){
+		if(!strcmp(argv[i], "-f") && i+1 < argc)
+			frames = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "-s") && i+1 < argc){
+			if(sscanf(argv[++i], "%dx%d", &width, &height) != 2)
+				usage();
+		}
+		else if(argv[i][0] == '-')
+			usage();
+		else
+			course_file = argv[i];
+	}
+	if(frames <= 0 || width <= 0 || height <= 0)
+		usage();
+
+	Course course;
+	if(!loadCourse(course, course_file)){
+		fprintf(stderr, "Unable to open %s\n", course_file);
+		return EXIT_FAILURE;
+	}
+	Agent player;
+	resetAgent(course, player);
+
+	if(!glfwInit())
+		return EXIT_FAILURE;
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+	GLFWwindow *window = glfwCreateWindow(1, 1, "spotbench", NULL, NULL);
+	if(!window){
+		fprintf(stderr, "Unable to create a GL 3.3 context\n");
+		glfwTerminate();
+		return EXIT_FAILURE;
+	}
+	glfwMakeContextCurrent(window);
+	gladLoadGLLoader((GLADloadproc) glfwGetProcAddress);
+
+	string vertex, fragment;
+	if(!readFile("TextureRender.vert", vertex) || !readFile("TextureRender.frag", fragment)){
+		fprintf(stderr, "Run from the game directory, TextureRender.vert/.frag are missing\n");
+		return EXIT_FAILURE;
+	}
+	Variant variants[] = {
+		{ "unlit", "", 0 },
+		{ "acos", NULL, 0 },
+		{ "cutoff", "LIGHT_SPOT", 0 },
+		{ "smooth", "LIGHT_SPOT LIGHT_SMOOTH", SPOT_SOFTNESS },
+	};
+	const int count = sizeof(variants) / sizeof(variants[0]);
+	for(int v=0;v<count;v++){
+		string log;
+		if(variants[v].defines)
+			variants[v].program = BuildShaders("TextureRender.vert", vertex, "TextureRender.frag", fragment, variants[v].defines, log);
+		else
+			variants[v].program = BuildShaders("TextureRender.vert", vertex, "acos", acos_fragment, NULL, log);
+		if(!variants[v].program){
+			fprintf(stderr, "%s", log.c_str());
+			return EXIT_FAILURE;
+		}
+	}
+
+	// Offscreen target at the game's window size
+	GLuint framebuffer, targets[2];
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glGenRenderbuffers(2, targets);
+	glBindRenderbuffer(GL_RENDERBUFFER, targets[0]);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, targets[0]);
+	glBindRenderbuffer(GL_RENDERBUFFER, targets[1]);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, targets[1]);
+	if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE){
+		fprintf(stderr, "Offscreen framebuffer incomplete\n");
+		return EXIT_FAILURE;
+	}
+	glViewport(0, 0, width, height);
+	glEnable(GL_DEPTH_TEST);
+	glDepthFunc(GL_LEQUAL);
+	glClearColor(0, 0, 0, 1);
+
+	Mesh meshes[2] = { createBlock(), createSky() };
+	createTexture();
+	vector<Object> objects;
+	courseObjects(course, objects);
+	float aspect = (float)width / height;
+
+	// Same first frame from every variant, compared against acos
+	vector<unsigned char> reference(width * height * 4), pixels(width * height * 4);
+	drawFrame(variants[1], objects, meshes, player, player.angle, aspect);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, &reference[0]);
+	for(int v=0;v<count;v++){
+		drawFrame(variants[v], objects, meshes, player, player.angle, aspect);
+		glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
+		variants[v].differing = 0;
+		for(int p=0;p<width * height;p++)
+			for(int c=0;c<3;c++)
+				if(abs(pixels[p*4 + c] - reference[p*4 + c]) > 1){
+					variants[v].differing++;
+					break;
+				}
+	}
+
+	// Variants take turns frame by frame, so they all see the same clocks and caches
+	typedef chrono::steady_clock Clock;
+	for(int f=0;f<frames;f++){
+		float angle = player.angle + 360.0f * f / frames;
+		for(int v=0;v<count;v++){
+			Clock::time_point start = Clock::now();
+			drawFrame(variants[v], objects, meshes, player, angle, aspect);
+			glFinish();
+			variants[v].msec.push_back(chrono::duration<double, milli>(Clock::now() - start).count());
+		}
+	}
+
+	printf("%s, %dx%d, %d frames of %s\n", (const char*)glGetString(GL_RENDERER), width, height, frames, course_file);
+	printf("%-8s %9s %9s %9s %10s\n", "variant", "mean ms", "p50 ms", "lighting", "differing");
+	double unlit = 0;
+	for(int v=0;v<count;v++){
+		vector<double> &msec = variants[v].msec;
+		double mean = 0;
+		for(int f=0;f<frames;f++)
+			mean += msec[f] / frames;
+		sort(msec.begin(), msec.end());
+		if(v == 0)
+			unlit = mean;
+		printf("%-8s %9.3f %9.3f %+9.3f %10lld\n", variants[v].name, mean, msec[frames / 2], mean - unlit, variants[v].differing);
+	}
+
+	glfwDestroyWindow(window);
+	glfwTerminate();
+	return 0;
+}
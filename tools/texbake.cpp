@@ -0,0 +1,212 @@
+/* Offline texture baking.
+ * Decodes every image given on the command line, builds its full mip chain
+ * and writes all of them into one cache file the game maps at startup.
+ * With -c, textures without transparency are stored DXT1 compressed.
+ *
+ *   texbake [-c] [-o images/textures.cache] image.png...
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <SOIL/SOIL.h>
+
+#include "texcache.h"
+
+using namespace std;
+
+static void usage()
+{
+	fprintf(stderr, "usage: texbake [-c] [-o cachefile] image.png...\n");
+	exit(EXIT_FAILURE);
+}
+
+/* Halve an RGBA image with a 2x2 box filter, clamping at odd edges */
+static void downsample(const vector<unsigned char> &src, int w, int h, vector<unsigned char> &dst, int &dw, int &dh)
+{
+	dw = w > 1 ? w/2 : 1;
+	dh = h > 1 ? h/2 : 1;
+	dst.resize((size_t)dw * dh * 4);
+	for(int y=0;y<dh;y++)
+		for(int x=0;x<dw;x++){
+			int x0 = min(2*x, w-1), x1 = min(2*x+1, w-1);
+			int y0 = min(2*y, h-1), y1 = min(2*y+1, h-1);
+			for(int c=0;c<4;c++){
+				int sum = src[((size_t)y0*w + x0)*4 + c] + src[((size_t)y0*w + x1)*4 + c]
+					+ src[((size_t)y1*w + x0)*4 + c] + src[((size_t)y1*w + x1)*4 + c];
+				dst[((size_t)y*dw + x)*4 + c] = (sum + 2) / 4;
+			}
+		}
+}
+
+static unsigned short pack565(const int *rgb)
+{
+	return (unsigned short)(((rgb[0] >> 3) << 11) | ((rgb[1] >> 2) << 5) | (rgb[2] >> 3));
+}
+
+static void unpack565(unsigned short c, int *rgb)
+{
+	rgb[0] = (c >> 11) * 255 / 31;
+	rgb[1] = ((c >> 5) & 63) * 255 / 63;
+	rgb[2] = (c & 31) * 255 / 31;
+}
+
+/* DXT1 in four colour mode: endpoints are the corners of the block's
+   colour bounding box, every texel picks the closest palette entry */
+static void compressBlock(const unsigned char *texels, unsigned char *out)
+{
+	int lo[3] = {255, 255, 255}, hi[3] = {0, 0, 0};
+	for(int t=0;t<16;t++)
+		for(int c=0;c<3;c++){
+			lo[c] = min(lo[c], (int)texels[t*4 + c]);
+			hi[c] = max(hi[c], (int)texels[t*4 + c]);
+		}
+	unsigned short c0 = pack565(hi), c1 = pack565(lo);
+	if(c0 < c1){
+		unsigned short swap = c0; c0 = c1; c1 = swap;
+	}
+	int palette[4][3];
+	unpack565(c0, palette[0]);
+	unpack565(c1, palette[1]);
+	for(int c=0;c<3;c++){
+		palette[2][c] = (2*palette[0][c] + palette[1][c]) / 3;
+		palette[3][c] = (palette[0][c] + 2*palette[1][c]) / 3;
+	}
+	unsigned indices = 0;
+	if(c0 != c1)
+		for(int t=0;t<16;t++){
+			int best = 0, best_err = 1 << 30;
+			for(int p=0;p<4;p++){
+				int err = 0;
+				for(int c=0;c<3;c++){
+					int d = texels[t*4 + c] - palette[p][c];
+					err += d*d;
+				}
+				if(err < best_err){
+					best_err = err;
+					best = p;
+				}
+			}
+			indices |= best << (2*t);
+		}
+	out[0] = c0 & 0xff; out[1] = c0 >> 8;
+	out[2] = c1 & 0xff; out[3] = c1 >> 8;
+	for(int b=0;b<4;b++)
+		out[4 + b] = (indices >> (8*b)) & 0xff;
+}
+
+static void compressLevel(const vector<unsigned char> &src, int w, int h, vector<unsigned char> &dst)
+{
+	int bw = (w + 3) / 4, bh = (h + 3) / 4;
+	dst.resize((size_t)bw * bh * 8);
+	unsigned char texels[64];
+	for(int by=0;by<bh;by++)
+		for(int bx=0;bx<bw;bx++){
+			// Partial blocks of the smallest levels repeat their last row/column
+			for(int t=0;t<16;t++){
+				int x = min(bx*4 + t%4, w-1), y = min(by*4 + t/4, h-1);
+				memcpy(texels + t*4, &src[((size_t)y*w + x)*4], 4);
+			}
+			compressBlock(texels, &dst[((size_t)by*bw + bx)*8]);
+		}
+}
+
+static int opaque(const unsigned char *pixels, size_t count)
+{
+	for(size_t p=0;p<count;p++)
+		if(pixels[p*4 + 3] != 255)
+			return 0;
+	return 1;
+}
+
+static size_t align(size_t offset)
+{
+	return (offset + TEXCACHE_ALIGN - 1) & ~(size_t)(TEXCACHE_ALIGN - 1);
+}
+
+int main(int argc, char **argv)
+{
+	const char *output = "images/textures.cache";
+	int compress = 0;
+	vector<const char*> files;
+	for(int i=1;i<argc;i++){
+		if(!strcmp(argv[i], "-c"))
+			compress = 1;
+		else if(!strcmp(argv[i], "-o") && i+1 < argc)
+			output = argv[++i];
+		else if(argv[i][0] == '-')
+			usage();
+		else
+			files.push_back(argv[i]);
+	}
+	if(files.empty())
+		usage();
+
+	vector<TexCacheEntry> entries(files.size());
+	vector<vector<unsigned char> > levels; // every baked level, in file order
+	size_t offset = align(sizeof(TexCacheHeader) + files.size() * sizeof(TexCacheEntry));
+	for(int f=0;f<files.size();f++){
+		TexCacheEntry &entry = entries[f];
+		memset(&entry, 0, sizeof(entry));
+		if(strlen(files[f]) >= TEXCACHE_NAME){
+			fprintf(stderr, "Name too long: %s\n", files[f]);
+			return EXIT_FAILURE;
+		}
+		strcpy(entry.name, files[f]);
+		int w, h;
+		unsigned char *image = SOIL_load_image(files[f], &w, &h, 0, SOIL_LOAD_RGBA);
+		if(!image || !hashFile(files[f], entry.hash)){
+			fprintf(stderr, "Unable to load %s\n", files[f]);
+			return EXIT_FAILURE;
+		}
+		vector<unsigned char> level(image, image + (size_t)w * h * 4), next;
+		entry.format = compress && opaque(image, (size_t)w * h) ? TEXCACHE_DXT1 : TEXCACHE_RGBA8;
+		entry.width = w;
+		entry.height = h;
+		SOIL_free_image_data(image);
+
+		// Full chain down to 1x1, as glGenerateMipmap would build it
+		for(int l=0;;l++){
+			if(l == TEXCACHE_LEVELS){
+				fprintf(stderr, "%s is too large\n", files[f]);
+				return EXIT_FAILURE;
+			}
+			levels.push_back(vector<unsigned char>());
+			if(entry.format == TEXCACHE_DXT1)
+				compressLevel(level, w, h, levels.back());
+			else
+				levels.back() = level;
+			entry.offset[l] = offset;
+			entry.size[l] = levels.back().size();
+			offset = align(offset + entry.size[l]);
+			entry.levels = l + 1;
+			if(w == 1 && h == 1)
+				break;
+			downsample(level, w, h, next, w, h);
+			level.swap(next);
+		}
+		printf("%s: %ux%u, %u levels, %s\n", entry.name, entry.width, entry.height, entry.levels,
+				entry.format == TEXCACHE_DXT1 ? "dxt1" : "rgba8");
+	}
+
+	FILE *out = fopen(output, "wb");
+	if(!out){
+		fprintf(stderr, "Unable to write %s\n", output);
+		return EXIT_FAILURE;
+	}
+	TexCacheHeader header = { TEXCACHE_MAGIC, TEXCACHE_VERSION, (unsigned)entries.size(), 0 };
+	fwrite(&header, sizeof(header), 1, out);
+	fwrite(&entries[0], sizeof(TexCacheEntry), entries.size(), out);
+	size_t written = sizeof(header) + entries.size() * sizeof(TexCacheEntry);
+	static const unsigned char zero[TEXCACHE_ALIGN] = {0};
+	for(int l=0;l<levels.size();l++){
+		size_t start = align(written);
+		fwrite(zero, 1, start - written, out);
+		fwrite(&levels[l][0], 1, levels[l].size(), out);
+		written = start + levels[l].size();
+	}
+	fclose(out);
+	printf("%s: %d textures, %lu bytes\n", output, (int)entries.size(), (unsigned long)written);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,124 @@
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <atomic>
+
+#include "trace.h"
+
+using namespace std;
+
+bool traceEnabled = false;
+
+struct TraceEvent {
+	const char *name;
+	string detail;
+	long long start, duration; // microseconds since traceStart
+	int tid;
+};
+
+static string trace_file;
+static chrono::steady_clock::time_point trace_epoch;
+static mutex trace_lock;
+static vector<TraceEvent> trace_events;
+static vector<pair<int, string> > thread_names;
+static atomic<int> next_tid(1);
+
+static int traceThread()
+{
+	static thread_local int tid = 0;
+	if(!tid)
+		tid = next_tid++;
+	return tid;
+}
+
+static long long now()
+{
+	return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - trace_epoch).count();
+}
+
+void traceStart(const char *filename)
+{
+	if(!filename || !*filename || traceEnabled)
+		return;
+	trace_file = filename;
+	trace_epoch = chrono::steady_clock::now();
+	traceEnabled = true;
+	traceThreadName("main");
+	atexit(traceFlush);
+}
+
+void traceThreadName(const char *name)
+{
+	if(!traceEnabled)
+		return;
+	int tid = traceThread();
+	lock_guard<mutex> guard(trace_lock);
+	thread_names.push_back(make_pair(tid, string(name)));
+}
+
+void TraceScope::begin(const char *span, const char *about)
+{
+	name = span;
+	if(about)
+		detail = about;
+	start = now();
+}
+
+void TraceScope::end()
+{
+	TraceEvent event;
+	event.name = name;
+	event.detail.swap(detail);
+	event.start = start;
+	event.duration = now() - start;
+	event.tid = traceThread();
+	lock_guard<mutex> guard(trace_lock);
+	trace_events.push_back(event);
+}
+
+static void writeString(FILE *out, const string &text)
+{
+	fputc('"', out);
+	for(int c=0;c<text.size();c++){
+		if(text[c] == '"' || text[c] == '\\')
+			fputc('\\', out);
+		if((unsigned char)text[c] >= 0x20)
+			fputc(text[c], out);
+	}
+	fputc('"', out);
+}
+
+void traceFlush()
+{
+	if(!traceEnabled)
+		return;
+	lock_guard<mutex> guard(trace_lock);
+	FILE *out = fopen(trace_file.c_str(), "w");
+	if(!out){
+		fprintf(stderr, "Could not write trace to %s\n", trace_file.c_str());
+		return;
+	}
+	fprintf(out, "{\"traceEvents\":[\n");
+	for(int t=0;t<thread_names.size();t++){
+		fprintf(out, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":",
+				t ? ",\n" : "", thread_names[t].first);
+		writeString(out, thread_names[t].second);
+		fprintf(out, "}}");
+	}
+	for(int e=0;e<trace_events.size();e++){
+		const TraceEvent &event = trace_events[e];
+		fprintf(out, "%s{\"ph\":\"X\",\"name\":", e || thread_names.size() ? ",\n" : "");
+		writeString(out, event.name);
+		fprintf(out, ",\"pid\":1,\"tid\":%d,\"ts\":%lld,\"dur\":%lld", event.tid, event.start, event.duration);
+		if(!event.detail.empty()){
+			fprintf(out, ",\"args\":{\"detail\":");
+			writeString(out, event.detail);
+			fprintf(out, "}");
+		}
+		fprintf(out, "}");
+	}
+	fprintf(out, "\n],\"displayTimeUnit\":\"ms\"}\n");
+	fclose(out);
+}
@@ -0,0 +1,51 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <string>
+
+/* Scoped trace spans, written as Chrome trace-event JSON (chrome://tracing,
+ * ui.perfetto.dev). Off unless traceStart() is given a file; a disabled
+ * span costs one branch on a global flag. */
+extern bool traceEnabled;
+
+/* Start recording if filename is set, e.g. from ADVENTURA_TRACE */
+void traceStart(const char *filename);
+/* Write everything recorded so far. Called automatically at exit. */
+void traceFlush();
+/* Name the calling thread in the trace */
+void traceThreadName(const char *name);
+
+class TraceScope {
+	public:
+		TraceScope(const char *name) : name(NULL)
+		{
+			if(traceEnabled)
+				begin(name, NULL);
+		}
+		/* detail, e.g. a file name, goes into the span's args */
+		TraceScope(const char *name, const char *detail) : name(NULL)
+		{
+			if(traceEnabled)
+				begin(name, detail);
+		}
+		~TraceScope()
+		{
+			if(name)
+				end();
+		}
+
+	private:
+		void begin(const char *name, const char *detail);
+		void end();
+
+		const char *name;
+		std::string detail;
+		long long start;
+};
+
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+/* Span from here to the end of the enclosing block */
+#define TRACE_SCOPE(...) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(__VA_ARGS__)
+
+#endif
@@ -0,0 +1,126 @@
+#include <algorithm>
+
+#include "trigger.h"
+
+using namespace std;
+
+TriggerSystem::TriggerSystem()
+{
+	for(int k=0;k<TRIGGER_KINDS;k++)
+		handlers[k] = NULL, contexts[k] = NULL;
+	clear();
+}
+
+void TriggerSystem::clear()
+{
+	triggers.clear();
+	inside.clear();
+	nearby.clear();
+	queue.clear();
+	for(int i=0;i<COURSE_CELLS;i++)
+		for(int j=0;j<COURSE_CELLS;j++)
+			cells[i][j].clear();
+	i0 = j0 = 0;
+	i1 = j1 = -1;
+}
+
+int TriggerSystem::add(const Course &course, int kind, int id, float minx, float maxx, float miny, float maxy, float minz, float maxz)
+{
+	Trigger t;
+	t.kind = kind;
+	t.id = id;
+	t.minx = minx, t.maxx = maxx;
+	t.miny = miny, t.maxy = maxy;
+	t.minz = minz, t.maxz = maxz;
+	t.active = 1;
+	int index = triggers.size();
+	triggers.push_back(t);
+	inside.push_back(0);
+
+	int ti0 = max(course.cellI(minz), 0), ti1 = min(course.cellI(maxz), COURSE_CELLS - 1);
+	int tj0 = max(course.cellJ(minx), 0), tj1 = min(course.cellJ(maxx), COURSE_CELLS - 1);
+	for(int i=ti0;i<=ti1;i++)
+		for(int j=tj0;j<=tj1;j++)
+			cells[i][j].push_back(index);
+
+	// The agent may already be standing where the new trigger appears
+	if(ti0 <= i1 && i0 <= ti1 && tj0 <= j1 && j0 <= tj1)
+		gather();
+	return index;
+}
+
+void TriggerSystem::remove(int trigger)
+{
+	triggers[trigger].active = 0;
+	inside[trigger] = 0;
+}
+
+void TriggerSystem::setHeight(int trigger, float miny, float maxy)
+{
+	triggers[trigger].miny = miny;
+	triggers[trigger].maxy = maxy;
+}
+
+int TriggerSystem::overlaps(const Trigger &t, const Agent &agent, float edge) const
+{
+	return agent.posx + edge/4 >= t.minx && agent.posx - edge/4 <= t.maxx &&
+		agent.posz + edge/4 >= t.minz && agent.posz - edge/4 <= t.maxz &&
+		agent.posy + edge/2 >= t.miny && agent.posy - edge/2 <= t.maxy;
+}
+
+void TriggerSystem::gather()
+{
+	nearby.clear();
+	for(int i=i0;i<=i1;i++)
+		for(int j=j0;j<=j1;j++)
+			for(int k=0;k<cells[i][j].size();k++)
+				nearby.push_back(cells[i][j][k]);
+	sort(nearby.begin(), nearby.end());
+	nearby.erase(unique(nearby.begin(), nearby.end()), nearby.end());
+}
+
+void TriggerSystem::update(const Course &course, const Agent &agent)
+{
+	float edge = course.edge;
+	int ni0 = max(course.cellI(agent.posz - edge/4), 0), ni1 = min(course.cellI(agent.posz + edge/4), COURSE_CELLS - 1);
+	int nj0 = max(course.cellJ(agent.posx - edge/4), 0), nj1 = min(course.cellJ(agent.posx + edge/4), COURSE_CELLS - 1);
+	if(ni0 != i0 || ni1 != i1 || nj0 != j0 || nj1 != j1){
+		left.swap(nearby);
+		i0 = ni0, i1 = ni1, j0 = nj0, j1 = nj1;
+		gather();
+		// Triggers left behind can be entered again later
+		int k = 0;
+		for(int l=0;l<left.size();l++){
+			while(k < nearby.size() && nearby[k] < left[l])
+				k++;
+			if(k == nearby.size() || nearby[k] != left[l])
+				inside[left[l]] = 0;
+		}
+	}
+
+	for(int k=0;k<nearby.size();k++){
+		int index = nearby[k];
+		const Trigger &t = triggers[index];
+		if(!t.active)
+			continue;
+		int now = overlaps(t, agent, edge);
+		if(now && !inside[index]){
+			TriggerEvent event;
+			event.trigger = index;
+			event.kind = t.kind;
+			event.id = t.id;
+			queue.push_back(event);
+		}
+		inside[index] = now;
+	}
+}
+
+void TriggerSystem::dispatch()
+{
+	while(!queue.empty()){
+		TriggerEvent event = queue.front();
+		queue.pop_front();
+		if(handlers[event.kind])
+			handlers[event.kind](contexts[event.kind], event);
+	}
+}
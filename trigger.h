@@ -0,0 +1,68 @@
+#ifndef TRIGGER_H
+#define TRIGGER_H
+
+#include <vector>
+#include <deque>
+
+#include "course.h"
+#include "agent.h"
+
+#define TRIGGER_TREASURE 0
+#define TRIGGER_PORTAL 1
+#define TRIGGER_KINDS 2
+
+struct Trigger {
+	int kind;
+	int id; // caller's data, e.g. the treasure index
+	float minx, maxx, miny, maxy, minz, maxz;
+	int active;
+};
+
+struct TriggerEvent {
+	int trigger;
+	int kind;
+	int id;
+};
+
+/* context is the pointer given to setHandler() */
+typedef void (*TriggerHandler)(void *context, const TriggerEvent &event);
+
+/* Trigger volumes bucketed by grid cell.
+ * The agent's set of overlapped cells is tracked between ticks; candidate
+ * triggers are only gathered again when that set changes, and only the
+ * triggers sharing a cell with the agent are tested. Enter events are
+ * queued and handed to the per-kind handlers by dispatch(). */
+class TriggerSystem {
+	public:
+		TriggerSystem();
+
+		/* Drop every trigger and forget the tracked agent cells */
+		void clear();
+
+		int add(const Course &course, int kind, int id, float minx, float maxx, float miny, float maxy, float minz, float maxz);
+		void remove(int trigger);
+		/* Move a trigger vertically; its cells stay the same */
+		void setHeight(int trigger, float miny, float maxy);
+
+		void setHandler(int kind, TriggerHandler handler, void *context) { handlers[kind] = handler; contexts[kind] = context; }
+
+		/* Queue enter events for the agent's current position */
+		void update(const Course &course, const Agent &agent);
+		/* Call the handlers for every queued event */
+		void dispatch();
+
+	private:
+		int overlaps(const Trigger &t, const Agent &agent, float edge) const;
+		void gather();
+
+		std::vector<Trigger> triggers;
+		std::vector<int> cells[COURSE_CELLS][COURSE_CELLS];
+		int i0, i1, j0, j1; // agent cell rectangle, empty when i0 > i1
+		std::vector<int> nearby, left;
+		std::vector<char> inside;
+		std::deque<TriggerEvent> queue;
+		TriggerHandler handlers[TRIGGER_KINDS];
+		void *contexts[TRIGGER_KINDS];
+};
+
+#endif